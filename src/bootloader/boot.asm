@@ -93,14 +93,8 @@ read_disk:
     .reads:
         mov dx, 0x1f0   ; 0x1f0 端口（为 16 bit 的寄存器）
         mov cx, 256     ; 一个扇区一般是 512 字节（即 256 字）
-        .readword:
-            in ax, dx
-            jmp $+2         ; 提供延迟
-            jmp $+2
-            jmp $+2
-            mov [edi], ax   ; 将读取数据写入到指定的内存地址处
-            add edi, 2
-            loop .readword
+        cld             ; 传输方向为地址递增
+        rep insw        ; 连续读取 cx 个字写入到 es:di 指定的内存地址处
         ret
 
 
@@ -164,14 +158,10 @@ write_disk:
     .writes:
         mov dx, 0x1f0   ; 0x1f0 端口（为 16 bit 的寄存器）
         mov cx, 256     ; 一个扇区一般是 512 字节（即 256 字）
-        .writeword:
-            mov ax, [edi]
-            out dx, ax  ; 将要写入的数据写入到指定端口处
-            jmp $+2     ; 提供延迟
-            jmp $+2
-            jmp $+2
-            add edi, 2
-            loop .writeword
+        mov si, di      ; rep outsw 从 ds:si 读取数据
+        cld             ; 传输方向为地址递增
+        rep outsw       ; 将 cx 个字连续写入到指定端口处
+        mov di, si      ; 更新下一个扇区的内存地址
         ret
 
 
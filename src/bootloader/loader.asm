@@ -96,7 +96,7 @@ protected_mode:
     ; 读取硬盘的内容到指定的内存地址处
     mov edi, 0x10000     ; 读取硬盘到的目标内存地址
     mov ecx, 10          ; 起始扇区的编号
-    mov bl,  200         ; 读取的扇区数量
+    mov bl,  255         ; 读取的扇区数量
 
     call read_disk
 
@@ -167,15 +167,9 @@ read_disk:
     
     .reads:
         mov dx, 0x1f0   ; 0x1f0 端口（为 16 bit 的寄存器）
-        mov cx, 256     ; 一个扇区一般是 512 字节（即 256 字）
-        .readword:
-            in ax, dx
-            jmp $+2         ; 提供延迟
-            jmp $+2
-            jmp $+2
-            mov [edi], ax   ; 将读取数据写入到指定的内存地址处
-            add edi, 2
-            loop .readword
+        mov ecx, 256    ; 一个扇区一般是 512 字节（即 256 字）
+        cld             ; 传输方向为地址递增
+        rep insw        ; 连续读取 ecx 个字写入到 es:edi 指定的内存地址处
         ret
 
 
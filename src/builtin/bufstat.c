@@ -0,0 +1,36 @@
+#include <xos/builtin.h>
+#include <xos/syscall.h>
+#include <xos/stdio.h>
+
+// 计算 part 占 total 的百分比
+static u32 percent(u32 part, u32 total) {
+    if (total == 0) {
+        return 0;
+    }
+    // 避免 part * 100 溢出 (此时 total 必然不小于 100)
+    if (part > 0xffffffff / 100) {
+        return part / (total / 100);
+    }
+    return part * 100 / total;
+}
+
+// 打印高速缓存统计信息
+void bufstat_main() {
+    buffer_stat_t info;
+    if (bufstat(&info) < 0) {
+        printf("bufstat: failed to get buffer statistics\n");
+        return;
+    }
+
+    printf("buffers:    %u (%u dirty)\n", info.buffers, info.dirty);
+    printf("lookups:    %u\n", info.lookups);
+    printf("hits:       %u (%u%%)\n", info.hits, percent(info.hits, info.lookups));
+    printf("misses:     %u (%u%%)\n", info.misses, percent(info.misses, info.lookups));
+    printf("evictions:  %u (a1 %u, am %u, promotions %u)\n",
+           info.evictions, info.a1_evictions, info.am_evictions, info.promotions);
+    printf("reclaims:   %u pages\n", info.reclaims);
+    printf("reads:      %u blocks\n", info.reads);
+    printf("writebacks: %u blocks\n", info.writebacks);
+    printf("errors:     %u\n", info.errors);
+    printf("waits:      %u (%u jiffies)\n", info.waits, info.wait_time);
+}
@@ -0,0 +1,43 @@
+#include <xos/builtin.h>
+#include <xos/syscall.h>
+#include <xos/stdio.h>
+
+// 打印块设备 stat 的延迟直方图，省略两种延迟都没有请求的桶
+// 总延迟明显大于服务时间说明请求主要在排队，否则说明设备本身较慢
+static void print_histogram(dev_stat_t *stat) {
+    printf("%s latency (us)         total   service\n", stat->name);
+    for (size_t i = 0; i < DEV_HIST_NR; i++) {
+        if (stat->latency[i] == 0 && stat->service[i] == 0) {
+            continue;
+        }
+        u32 low = i == 0 ? 0 : 1 << i;
+        if (i == DEV_HIST_NR - 1) {
+            printf("    %8u ~          %8u  %8u\n", low, stat->latency[i], stat->service[i]);
+        } else {
+            printf("    %8u ~ %8u %8u  %8u\n", low, (1 << (i + 1)) - 1, stat->latency[i], stat->service[i]);
+        }
+    }
+}
+
+// 打印块设备 I/O 统计信息和延迟直方图
+void iostat_main() {
+    dev_stat_t stat;
+
+    printf("device       reads  rsectors rmerges   writes  wsectors wmerges errors queue   max  busy(ms)\n");
+    for (devid_t dev_id = 0; dev_id < DEV_NR; dev_id++) {
+        if (iostat(dev_id, &stat) < 0) {
+            continue;
+        }
+        printf("%-8s %9u %9u %7u %8u %9u %7u %6u %5u %5u %9u\n",
+               stat.name, stat.ios[REQ_READ], stat.sectors[REQ_READ], stat.merges[REQ_READ],
+               stat.ios[REQ_WRITE], stat.sectors[REQ_WRITE], stat.merges[REQ_WRITE],
+               stat.errors, stat.queued, stat.max_queued, stat.busy);
+    }
+
+    for (devid_t dev_id = 0; dev_id < DEV_NR; dev_id++) {
+        if (iostat(dev_id, &stat) < 0 || stat.ios[REQ_READ] + stat.ios[REQ_WRITE] == 0) {
+            continue;
+        }
+        print_histogram(&stat);
+    }
+}
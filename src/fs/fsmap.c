@@ -1,6 +1,10 @@
 #include <xos/fs.h>
 #include <xos/assert.h>
 #include <xos/bitmap.h>
+#include <xos/stdlib.h>
+
+#define READAHEAD_MIN 4     // 预读窗口的初始块数
+#define READAHEAD_MAX 32    // 预读窗口的最大块数
 
 // 分配一个文件块并返回块号 (从 1 开始计数)，分配失败返回 0
 size_t balloc(devid_t dev_id) {
@@ -20,8 +24,7 @@ size_t balloc(devid_t dev_id) {
         nr = bitmap_insert_nbits(&bitmap, 1);
         // 如果在合法范围扫描到空闲的块，返回扫描到的空闲块的块号，并标记 zmap 相应的位
         if (nr != EOF && nr < sb->desc->nzones) {
-            buf->dirty = true;
-            bwrite(buf);
+            bdirty(buf);
             return nr;
         }
     }
@@ -50,12 +53,11 @@ void bfree(devid_t dev_id, size_t nr) {
 
         assert(bitmap_contains(&bitmap, nr)); // 禁止释放未分配的块
         bitmap_remove(&bitmap, nr);
-        buf->dirty = true;
+        // 位图块由回写线程统一写回
+        bdirty(buf);
 
         break;
     }
-    // TODO: 调试时强行同步，其它时候可以释放时统一写回，提高效能
-    bwrite(buf);
 }
 
 // 分配一个文件系统 inode 并返回 inode 号 (从 1 开始计数)
@@ -75,8 +77,7 @@ size_t ialloc(devid_t dev_id) {
         nr = bitmap_insert_nbits(&bitmap, 1);
         // 如果在合法范围扫描到空闲的 inode，返回扫描到的空闲 inode 号，并标记 imap 相应的位
         if (nr != EOF && nr < sb->desc->ninodes) {
-            buf->dirty = true;
-            bwrite(buf);
+            bdirty(buf);
             return nr;
         }
     }
@@ -104,17 +105,16 @@ void ifree(devid_t dev_id, size_t nr) {
 
         assert(bitmap_contains(&bitmap, nr)); // 禁止释放未分配的块
         bitmap_remove(&bitmap, nr);
-        buf->dirty = true;
+        // 位图块由回写线程统一写回
+        bdirty(buf);
 
         break;
     }
-    // TODO: 调试时强行同步，其它时候可以释放时统一写回，提高效能
-    bwrite(buf);
 }
 
 // 获取 inode 索引的第 nr 个块对应的块号
-// 如果该块不存在且 create 为 true，则创建
-size_t bmap(inode_t *inode, size_t nr, bool create) {
+// 如果该块不存在且 create 为 true，则创建；读取索引块失败时返回 0
+static size_t get_zone(inode_t *inode, size_t nr, bool create) {
     // 保证块号合法
     assert(nr >= 0 && nr < TOTAL_BLOCKS);
 
@@ -157,15 +157,21 @@ reckon:
     while (level--) {
         if (!array[index] && create) {
             array[index] = balloc(inode->dev_id);
-            buf->dirty = true;
+            bdirty(buf);
         }
-        bwrite(buf);
 
         // 索引不存在且 create 为 false 直接返回
         if (!array[index]) break;
 
-        // 读取下一层级对应的块
-        buf = bread(inode->dev_id, array[index]);
+        // 读取下一层级对应的块，并释放当前层级的块 (inode 所在的块由 inode 持有)
+        buffer_t *next = bread(inode->dev_id, array[index]);
+        if (buf != inode->buf) {
+            brelse(buf);
+        }
+        if (next == NULL) {
+            return 0;
+        }
+        buf = next;
         array = (u16 *)buf->data;
         index = nr / blocks[level];
         nr = nr % blocks[level];
@@ -173,8 +179,50 @@ reckon:
 
     if (!array[index] && create) {
         array[index] = balloc(inode->dev_id);
-        buf->dirty = true;
+        bdirty(buf);
+    }
+
+    size_t block = array[index];
+    if (buf != inode->buf) {
+        brelse(buf);
+    }
+    return block;
+}
+
+// 根据 inode 的顺序访问情况调整预读窗口，并异步预读第 nr 块之后的块
+// 顺序访问时窗口翻倍增长，随机访问时窗口减半收缩
+static void readahead(inode_t *inode, size_t nr) {
+    if (nr == inode->ra_next) {
+        inode->ra_window = inode->ra_window ? 
+            MIN(inode->ra_window * 2, READAHEAD_MAX) : READAHEAD_MIN;
+    } else {
+        inode->ra_window >>= 1;
+        inode->ra_end = 0;
+    }
+    inode->ra_next = nr + 1;
+
+    // 只预读文件范围内，且尚未提交预读的块
+    size_t start = MAX(nr + 1, inode->ra_end);
+    size_t end = MIN(nr + 1 + inode->ra_window, div_round_up(inode->desc->size, BLOCK_SIZE));
+    end = MIN(end, TOTAL_BLOCKS);
+
+    for (size_t i = start; i < end; i++) {
+        size_t block = get_zone(inode, i, false);
+        // 跳过文件空洞
+        if (block) {
+            bprefetch(inode->dev_id, block);
+        }
+    }
+    inode->ra_end = MAX(inode->ra_end, end);
+}
+
+// 获取 inode 索引的第 nr 个块对应的块号
+// 如果该块不存在且 create 为 true，则创建；如果 create 为 false，则按顺序访问情况进行预读
+// 块不存在或者读取索引块失败时返回 0
+size_t bmap(inode_t *inode, size_t nr, bool create) {
+    size_t block = get_zone(inode, nr, create);
+    if (!create && block) {
+        readahead(inode, nr);
     }
-    bwrite(buf);
-    return array[index];
+    return block;
 }
@@ -67,12 +67,16 @@ inode_t *iget(devid_t dev_id, size_t nr) {
 
     assert(nr <= sb->desc->ninodes); // 保证 inode 号合法
 
+    // 读取 inode 所在的块，失败时不占用 inode
+    size_t block = inode_block(sb, nr);
+    buffer_t *buf = bread(dev_id, block);
+    if (buf == NULL) {
+        return NULL;
+    }
+
     inode = get_free_inode();
     // 加入超级块的使用 inode 链表
     list_push_back(&sb->inode_list, &inode->node);
-    // 读取 inode 所在的块并设置
-    size_t block = inode_block(sb, nr);
-    buffer_t *buf = bread(dev_id, block);
 
     inode->buf = buf;
     inode->desc = &((inode_desc_t *)buf->data)[(nr - 1) % BLOCK_INODES];
@@ -81,6 +85,9 @@ inode_t *iget(devid_t dev_id, size_t nr) {
     inode->count = 1;
     inode->atime = time();
     inode->ctime = inode->desc->mtime; 
+    inode->ra_next = 0;
+    inode->ra_window = 0;
+    inode->ra_end = 0;
 
     return inode;
 }
@@ -0,0 +1,110 @@
+#include <xos/fs.h>
+#include <xos/device.h>
+#include <xos/memory.h>
+#include <xos/string.h>
+#include <xos/stat.h>
+#include <xos/stdlib.h>
+#include <xos/debug.h>
+
+extern time_t sys_time();
+
+// 写入设备 dev_id 的第 block 块
+static i32 mkfs_write(devid_t dev_id, void *data, size_t block) {
+    return dev_write(dev_id, data, BLOCK_SECS, block * BLOCK_SECS, 0);
+}
+
+// 写入 count 块位图，前 used 位为占用，total 位之后超出范围的位也标记为占用
+static i32 mkfs_bitmap(devid_t dev_id, u8 *data, size_t block, size_t count, size_t used, size_t total) {
+    for (size_t i = 0; i < count; i++) {
+        memset(data, 0, BLOCK_SIZE);
+        for (size_t bit = 0; bit < BLOCK_BITS; bit++) {
+            size_t idx = i * BLOCK_BITS + bit;
+            if (idx < used || idx >= total) {
+                data[bit / 8] |= 1 << (bit % 8);
+            }
+        }
+        if (mkfs_write(dev_id, data, block + i) < 0) {
+            return EOF;
+        }
+    }
+    return 0;
+}
+
+// 将设备 dev_id 格式化为 MINIX 文件系统 (第一版，文件名 14 字节)，只包含根目录，失败返回 EOF
+// 与 mkfs.minix 相同，inode 数量默认为块数的三分之一
+i32 minix_mkfs(devid_t dev_id) {
+    size_t blocks = dev_ioctl(dev_id, DEV_CMD_SECTOR_COUNT, NULL, 0) / BLOCK_SECS;
+    blocks = MIN(blocks, 0xffff);
+
+    // inode 占满整块，inode 位图的第 0 位保留
+    size_t ninodes = div_round_up(blocks / 3, BLOCK_INODES) * BLOCK_INODES;
+    ninodes = MIN(ninodes, MIN(IMAP_MAX_BLOCKS * BLOCK_BITS - 1, 0xffff));
+    size_t imap_blocks = div_round_up(ninodes + 1, BLOCK_BITS);
+    size_t inode_blocks = div_round_up(ninodes, BLOCK_INODES);
+
+    // 块位图的第 0 位保留，之后每一位对应一个数据块，块位图本身的大小影响数据块的起始位置
+    size_t zmap_blocks = 1;
+    size_t first_data_zone;
+    while (true) {
+        first_data_zone = 2 + imap_blocks + zmap_blocks + inode_blocks;
+        size_t bits = blocks > first_data_zone ? blocks - first_data_zone + 1 : 0;
+        if (div_round_up(bits, BLOCK_BITS) <= zmap_blocks) break;
+        zmap_blocks++;
+    }
+    if (first_data_zone >= blocks || zmap_blocks > ZMAP_MAX_BLOCKS) {
+        LOGK("Device %d too small to make file system\n", dev_id);
+        return EOF;
+    }
+
+    u8 *data = (u8 *)kalloc_page(1);
+    i32 ret = EOF;
+
+    // 超级块
+    memset(data, 0, BLOCK_SIZE);
+    super_desc_t *desc = (super_desc_t *)data;
+    desc->ninodes = ninodes;
+    desc->nzones = blocks;
+    desc->imap_blocks = imap_blocks;
+    desc->zmap_blocks = zmap_blocks;
+    desc->first_data_zone = first_data_zone;
+    desc->log_zone_size = 0;
+    desc->max_size = BLOCK_SIZE * TOTAL_BLOCKS;
+    desc->magic = MINIX_MAGIC;
+    if (mkfs_write(dev_id, data, 1) < 0) goto rollback;
+
+    // inode 位图：保留位和根目录；块位图：保留位和根目录的数据块
+    if (mkfs_bitmap(dev_id, data, 2, imap_blocks, 2, ninodes + 1) < 0) goto rollback;
+    if (mkfs_bitmap(dev_id, data, 2 + imap_blocks, zmap_blocks, 2, blocks - first_data_zone + 1) < 0) goto rollback;
+
+    // inode 表，第 1 个 inode 为根目录
+    size_t inode_block = 2 + imap_blocks + zmap_blocks;
+    for (size_t i = 0; i < inode_blocks; i++) {
+        memset(data, 0, BLOCK_SIZE);
+        if (i == 0) {
+            inode_desc_t *root = (inode_desc_t *)data;
+            root->mode = IFDIR | 0755;
+            root->size = sizeof(dentry_t) * 2;
+            root->mtime = sys_time();
+            root->nlinks = 2;
+            root->zone[0] = first_data_zone;
+        }
+        if (mkfs_write(dev_id, data, inode_block + i) < 0) goto rollback;
+    }
+
+    // 根目录的数据块，包含 . 和 ..
+    memset(data, 0, BLOCK_SIZE);
+    dentry_t *entry = (dentry_t *)data;
+    entry[0].inode = 1;
+    strcpy(entry[0].name, ".");
+    entry[1].inode = 1;
+    strcpy(entry[1].name, "..");
+    if (mkfs_write(dev_id, data, first_data_zone) < 0) goto rollback;
+
+    LOGK("Device %d make file system inodes %d zones %d first data zone %d\n",
+         dev_id, ninodes, blocks, first_data_zone);
+    ret = 0;
+
+rollback:
+    kfree_page((u32)data, 1);
+    return ret;
+}
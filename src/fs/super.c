@@ -4,6 +4,12 @@
 #include <xos/string.h>
 #include <xos/assert.h>
 #include <xos/debug.h>
+#include <xos/memory.h>
+
+// 根文件系统所在的设备名，编译时通过 -DROOT_DEV=... 指定，为空时自动选择
+#ifndef ROOT_DEV
+#define ROOT_DEV ""
+#endif
 
 // 系统最多支持 16 个文件系统
 #define SUPERBLOCK_NR 16
@@ -36,7 +42,7 @@ superblock_t *get_superblock(devid_t dev_id) {
     return NULL;
 }
 
-// 读取设备号 dev_id 对应的超级块
+// 读取设备号 dev_id 对应的超级块，读取失败或者不是 MINIX 文件系统时返回 NULL
 superblock_t *read_superblock(devid_t dev_id) {
     // 在超级块表中寻找所需的超级块，如果找到则直接返回
     superblock_t *sb = get_superblock(dev_id);
@@ -50,53 +56,84 @@ superblock_t *read_superblock(devid_t dev_id) {
     
     // 读取超级块并设置
     buffer_t *buf = bread(dev_id, 1);
+    if (buf == NULL) {
+        return NULL;
+    }
+    if (((super_desc_t *)buf->data)->magic != MINIX_MAGIC) {
+        LOGK("Device %d is not a MINIX file system\n", dev_id);
+        brelse(buf);
+        return NULL;
+    }
     sb->buf = buf;
     sb->desc = (super_desc_t *)buf->data;
-    sb->dev_id = dev_id;
-
-    assert(sb->desc->magic == MINIX_MAGIC);
 
     // 因为可能不需要这么多的位图空间，所以需要将其设置为 0，防止非法访问
     memset(sb->imaps, 0, sizeof(sb->imaps));
     memset(sb->zmaps, 0, sizeof(sb->zmaps));
 
     // 块位图从第 2 块开始，第 0 块为 boot block，第 1 块为 super block
-    size_t idx = 2;
-
-    // 读取 inode 位图
-    for (size_t i = 0; i < sb->desc->imap_blocks; i++) {
-        assert(i < IMAP_MAX_BLOCKS);
-        if (sb->imaps[i] = bread(dev_id, idx)) 
-            idx++;
-        else 
-            panic("unreachable!!!");
+    // inode 位图与块位图在磁盘上连续存放，合并为一次请求读取
+    size_t imap_blocks = sb->desc->imap_blocks;
+    size_t zmap_blocks = sb->desc->zmap_blocks;
+    assert(imap_blocks <= IMAP_MAX_BLOCKS);
+    assert(zmap_blocks <= ZMAP_MAX_BLOCKS);
+
+    buffer_t *maps[IMAP_MAX_BLOCKS + ZMAP_MAX_BLOCKS];
+    if (bread_cluster(dev_id, 2, imap_blocks + zmap_blocks, maps) < 0) {
+        LOGK("Reading bitmaps of device %d failed\n", dev_id);
+        for (size_t i = 0; i < imap_blocks + zmap_blocks; i++) {
+            brelse(maps[i]);
+        }
+        brelse(buf);
+        return NULL;
     }
+    // 位图读取成功后才占用超级块
+    sb->dev_id = dev_id;
 
-    // 读取块位图
-    for (size_t i = 0; i < sb->desc->zmap_blocks; i++) {
-        assert(i < ZMAP_MAX_BLOCKS);
-        if (sb->zmaps[i] = bread(dev_id, idx)) 
-            idx++;
-        else 
-            panic("unreachable!!!");
+    // 设置 inode 位图
+    for (size_t i = 0; i < imap_blocks; i++) {
+        sb->imaps[i] = maps[i];
+    }
+
+    // 设置块位图
+    for (size_t i = 0; i < zmap_blocks; i++) {
+        sb->zmaps[i] = maps[imap_blocks + i];
     }
 
     return sb;
 }
 
+// 获取根文件系统所在的设备
+// 优先使用编译时指定的设备，其次是启动时加载了 initrd 的内存虚拟磁盘，最后是主硬盘的首个分区
+static dev_t *root_device() {
+    if (ROOT_DEV[0] != EOS) {
+        return dev_find_name(ROOT_DEV);
+    }
+    if (get_initrd_size() > 0) {
+        return dev_find(DEV_RAMDISK, 0);
+    }
+    return dev_find(DEV_ATA_PART, 0);
+}
+
 // 挂载根文件系统
 static void mount_root() {
     LOGK("Mount root file system...\n");
     
-    // 假设主硬盘的首个分区是根文件系统
-    dev_t *dev = dev_find(DEV_ATA_PART, 0);
+    dev_t *dev = root_device();
     assert(dev);
+    LOGK("Root device %s\n", dev->name);
 
     // 读取根文件系统的超级块
     root = read_superblock(dev->dev_id);
+    if (root == NULL) {
+        panic("Mount root file system on %s failed!!!", dev->name);
+    }
 
     // 初始化根目录 inode
     root->iroot = iget(dev->dev_id, 1);
+    if (root->iroot == NULL) {
+        panic("Read root inode on %s failed!!!", dev->name);
+    }
 
     size_t nr = 0;
     inode_t *inode = iget(dev->dev_id, 1);
@@ -0,0 +1,136 @@
+#ifndef XOS_AHCI_H
+#define XOS_AHCI_H
+
+#include <xos/types.h>
+#include <xos/device.h>
+#include <xos/ata.h>
+
+// AHCI 控制器最多支持的端口数量
+#define AHCI_PORT_NR 32
+// 支持的 SATA 磁盘数量
+#define AHCI_DISK_NR 4
+// 每个端口的命令槽数量
+#define AHCI_SLOT_NR 32
+// 每个命令表的物理区域描述符数量 (合并后的请求每个扇区至多占用一个描述符)
+#define AHCI_PRD_NR DEV_MERGE_MAX
+
+// HBA 端口寄存器
+typedef volatile struct ahci_port_t {
+    u32 clb;        // 命令列表基址 (1K 对齐)
+    u32 clbu;       // 命令列表基址高 32 位
+    u32 fb;         // FIS 接收区基址 (256B 对齐)
+    u32 fbu;        // FIS 接收区基址高 32 位
+    u32 is;         // 中断状态
+    u32 ie;         // 中断允许
+    u32 cmd;        // 命令和状态
+    u32 reserved0;
+    u32 tfd;        // 任务文件数据 (状态和错误寄存器)
+    u32 sig;        // 设备签名
+    u32 ssts;       // SATA 状态
+    u32 sctl;       // SATA 控制
+    u32 serr;       // SATA 错误
+    u32 sact;       // SATA 活动 (正在执行的 NCQ 命令标签)
+    u32 ci;         // 命令发出
+    u32 sntf;       // SATA 通知
+    u32 fbs;        // 基于 FIS 的切换控制
+    u32 reserved1[11];
+    u32 vendor[4];
+} ahci_port_t;
+
+// HBA 寄存器 (ABAR)
+typedef volatile struct ahci_hba_t {
+    u32 cap;        // 主机能力
+    u32 ghc;        // 全局主机控制
+    u32 is;         // 中断状态 (每个端口一位)
+    u32 pi;         // 已实现的端口
+    u32 vs;         // 版本
+    u32 ccc_ctl;    // 命令完成合并控制
+    u32 ccc_ports;  // 命令完成合并端口
+    u32 em_loc;     // 外壳管理位置
+    u32 em_ctl;     // 外壳管理控制
+    u32 cap2;       // 主机扩展能力
+    u32 bohc;       // BIOS/OS 交接控制
+    u8 reserved[0x74];
+    u8 vendor[0x60];
+    ahci_port_t ports[AHCI_PORT_NR]; // 端口寄存器
+} ahci_hba_t;
+
+// 命令头，命令列表由 32 个命令头组成
+typedef struct ahci_cmd_header_t {
+    u16 flags;          // 0~4 位为命令 FIS 的双字数，第 6 位表示写入设备
+    u16 prdtl;          // 物理区域描述符数量
+    volatile u32 prdbc; // 已传输的字节数
+    u32 ctba;           // 命令表基址 (128B 对齐)
+    u32 ctbau;          // 命令表基址高 32 位
+    u32 reserved[4];
+} _packed ahci_cmd_header_t;
+
+// 物理区域描述符
+typedef struct ahci_prd_t {
+    u32 dba;        // 数据区域的物理地址 (字对齐)
+    u32 dbau;       // 数据区域物理地址高 32 位
+    u32 reserved;
+    u32 dbc;        // 0~21 位为字节数减一，第 31 位表示完成时中断
+} _packed ahci_prd_t;
+
+// 命令表
+typedef struct ahci_cmd_table_t {
+    u8 cfis[64];    // 命令 FIS
+    u8 acmd[16];    // ATAPI 命令
+    u8 reserved[48];
+    ahci_prd_t prdt[AHCI_PRD_NR]; // 物理区域描述符表
+} _packed ahci_cmd_table_t;
+
+// 主机到设备的寄存器 FIS
+typedef struct ahci_fis_h2d_t {
+    u8 type;        // FIS 类型 (0x27)
+    u8 flags;       // 第 7 位表示命令 FIS
+    u8 command;     // 命令
+    u8 feature_low; // 功能寄存器低字节
+    u8 lba0;        // LBA 0~7 位
+    u8 lba1;        // LBA 8~15 位
+    u8 lba2;        // LBA 16~23 位
+    u8 device;      // 设备寄存器
+    u8 lba3;        // LBA 24~31 位
+    u8 lba4;        // LBA 32~39 位
+    u8 lba5;        // LBA 40~47 位
+    u8 feature_high;// 功能寄存器高字节
+    u8 count_low;   // 扇区数量低字节 (NCQ 命令中为标签)
+    u8 count_high;  // 扇区数量高字节
+    u8 icc;         // 同步命令完成
+    u8 control;     // 控制寄存器
+    u32 reserved;
+} _packed ahci_fis_h2d_t;
+
+// 命令槽
+typedef struct ahci_slot_t {
+    request_t *request; // 命令槽正在执行的请求
+    u8 retries;         // 请求已重试的次数
+} ahci_slot_t;
+
+// SATA 磁盘分区
+typedef struct ahci_partition_t {
+    char name[8];               // 分区名称
+    struct ahci_disk_t *disk;   // 分区所在的磁盘
+    PARTITION_FS system;        // 分区类型 (表示文件系统)
+    u32 start_lba;              // 分区起始扇区的 LBA
+    size_t count;               // 分区占有的扇区数
+} ahci_partition_t;
+
+// SATA 磁盘 (AHCI 端口)
+typedef struct ahci_disk_t {
+    char name[8];                   // 磁盘名称
+    ahci_port_t *port;              // 端口寄存器
+    u8 index;                       // 端口号
+    size_t total_lba;               // 可用扇区的数量
+    bool ncq;                       // 是否使用原生命令队列 (NCQ)
+    u8 depth;                       // 使用的命令槽数量 (同时执行的最大请求数)
+    u32 issued;                     // 正在执行请求的命令槽位图
+    ahci_cmd_header_t *cmds;        // 命令列表
+    u8 *fis;                        // FIS 接收区
+    ahci_cmd_table_t *tables;       // 每个命令槽的命令表
+    ahci_slot_t slots[AHCI_SLOT_NR];// 命令槽
+    ahci_partition_t parts[ATA_PARTITION_NR]; // 硬盘分区
+} ahci_disk_t;
+
+#endif
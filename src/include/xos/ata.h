@@ -18,6 +18,13 @@
 struct ata_bus_t;
 struct ata_disk_t;
 
+// 物理区域描述符 (Physical Region Descriptor)，描述一段 DMA 传输的内存区域
+typedef struct ata_prd_t {
+    u32 addr;   // 内存区域的物理地址
+    u16 len;    // 内存区域的字节数 (0 表示 64K)
+    u16 flags;  // 标志，最高位表示最后一个描述符
+} _packed ata_prd_t;
+
 // 分区文件系统标识
 typedef enum PARTITION_FS {
     PARTITION_FS_FAT12 = 1,     // FAT12
@@ -39,10 +46,14 @@ typedef struct ata_partition_t {
 // ATA 磁盘
 typedef struct ata_disk_t {
     char name[8];           // 磁盘名称
+    devid_t dev_id;         // 磁盘的设备号
     struct ata_bus_t *bus;  // 所在的 ATA 总线
     u8 selector;            // 磁盘选择信息
     bool master;            // 是否为主盘
     size_t total_lba;       // 可用扇区的数量
+    bool dma;               // 是否支持 DMA 传输
+    u8 multiple;            // 多扇区模式下每次中断传输的扇区数，为 1 表示单扇区模式
+    request_t *request;     // 分配给磁盘的请求 (等待总线空闲或者正在传输)
     ata_partition_t parts[ATA_PARTITION_NR]; // 硬盘分区
 } ata_disk_t;
 
@@ -54,7 +65,16 @@ typedef struct ata_bus_t {
     u16 ctlbase;                    // 总线控制寄存器基址
     ata_disk_t disks[ATA_DISK_NR];  // 挂载的磁盘
     ata_disk_t *active;             // 当前选择的磁盘
-    task_t *waiter;                 // 等待总线忙碌结束的进程
+    request_t *request;             // 总线上正在传输的请求
+    size_t sector;                  // 正在传输的请求已完成的扇区数
+    u16 bmbase;                     // 总线主控 (Bus Master) DMA 寄存器基址，为 0 表示不支持 DMA
+    ata_prd_t *prdt;                // 物理区域描述符表
+    bool dma;                       // 正在传输的请求是否使用 DMA
+    u32 expires;                    // 当前命令的超时时刻 (jiffies)
+    u8 retries;                     // 正在传输的请求已重试的次数
+    bool resetting;                 // 驱动器是否正在软件复位
+    u8 pending;                     // 等待驱动器就绪后才能继续的步骤 (发送命令、写入第一个块或恢复磁盘设置)
+    u8 setup;                       // 复位后正在恢复多扇区模式的磁盘序号
 } ata_bus_t;
 
 // 磁盘分区表项
@@ -85,8 +105,14 @@ i32 ata_pio_read(ata_disk_t *disk, void *buf, u8 count, size_t lba);
 // 将缓冲区 buf 的数据写入磁盘 disk 的第 lba 个扇区开始的连续 count 个扇区
 i32 ata_pio_write(ata_disk_t *disk, void *buf, u8 count, size_t lba);
 
+// 开始执行磁盘 disk 的块设备请求 req，由中断驱动完成传输
+i32 ata_pio_request(ata_disk_t *disk, request_t *req);
+
+// 时钟中断时检测总线上等待驱动器就绪的步骤，驱动器就绪时不产生中断
+void ata_clock();
+
 // 发送分区控制命令，获取对应信息
-i32 ata_pio_partition_ioctl(ata_partition_t part, dev_cmd_t cmd, void *args, i32 flags);
+i32 ata_pio_partition_ioctl(ata_partition_t *part, dev_cmd_t cmd, void *args, i32 flags);
 // 从分区 part 的第 lba 个扇区开始读取
 i32 ata_pio_partition_read(ata_partition_t *part, void *buf, u8 count, size_t lba);
 // 从分区 part 的第 lba 个扇区开始写入
@@ -0,0 +1,58 @@
+#ifndef XOS_BLKCACHE_H
+#define XOS_BLKCACHE_H
+
+#include <xos/types.h>
+#include <xos/list.h>
+#include <xos/device.h>
+#include <xos/task.h>
+
+// 缓存块的扇区数 (与文件系统块大小相同)
+#define CACHE_BLOCK_SECS 2
+// 缓存设备元数据的魔数
+#define CACHE_MAGIC 0x57424348
+// 每个扇区保存的块映射项数量
+#define CACHE_MAP_PER_SECTOR (SECTOR_SIZE / sizeof(u32))
+// 块映射项：无效的缓存块
+#define CACHE_INVALID 0xffffffff
+// 块映射项：缓存块中的数据尚未写回后备设备
+#define CACHE_DIRTY 0x80000000
+// 后备块号到缓存块的哈希桶数量
+#define CACHE_HASH_NR 1024
+
+// 缓存设备第 0 个扇区保存的元数据头，之后的扇区保存块映射 (每个缓存块对应一个后备块号)，再之后是缓存块
+typedef struct cache_header_t {
+    u32 magic;      // 魔数
+    u32 sectors;    // 后备设备的扇区数
+    u32 blocks;     // 缓存块数量
+} cache_header_t;
+
+// 缓存块
+typedef struct cache_block_t {
+    list_node_t node;   // LRU 链表节点
+    u32 next;           // 哈希链表中下一个缓存块的序号
+} cache_block_t;
+
+// 写回缓存块设备，以快速的缓存设备加速慢速的后备设备
+// 所有写入和命中的读取只访问缓存设备，脏块由 cache 线程在空闲时写回后备设备
+typedef struct blkcache_t {
+    char name[8];               // 设备名称
+    devid_t dev_id;             // 设备号
+    devid_t backing;            // 后备设备
+    devid_t cache;              // 缓存设备
+    size_t sectors;             // 后备设备的扇区数
+    size_t blocks;              // 缓存块数量
+    size_t data_start;          // 缓存块在缓存设备上的起始扇区
+    u32 *map;                   // 块映射 (与缓存设备上保存的相同)
+    cache_block_t *entries;     // 缓存块
+    u32 *hash;                  // 哈希桶，保存每个哈希链表首个缓存块的序号
+    list_t lru;                 // LRU 链表，最近使用的缓存块位于头部，无效的缓存块位于尾部
+    size_t dirty;               // 脏块数量
+    u8 *buf;                    // 读写不完整的块以及写回脏块时使用的缓冲区
+    request_t *request;         // 等待 cache 线程执行的请求
+    task_t *waiter;             // 等待请求或脏块的 cache 线程
+} blkcache_t;
+
+// 以 cache 设备缓存 backing 设备，创建写回缓存块设备 name，失败返回 EOF
+devid_t blkcache_install(char *name, devid_t backing, devid_t cache);
+
+#endif
@@ -3,12 +3,18 @@
 
 #include <xos/types.h>
 #include <xos/list.h>
-#include <xos/mutex.h>
 
 #define SECTOR_SIZE 512                         // 扇区大小 512B
 #define BLOCK_SECS  2                           // 一块占 2 个扇区
 #define BLOCK_SIZE  (BLOCK_SECS * SECTOR_SIZE)  // 块大小 1024B
 
+// 高速缓存状态
+#define BUF_LOCKED      0x01    // 加锁，缓存正被某个任务独占 (例如进行 I/O)
+#define BUF_IO          0x02    // I/O 进行中
+#define BUF_UPTODATE    0x04    // 数据有效
+#define BUF_DIRTY       0x08    // 脏，数据与设备不一致
+#define BUF_ERROR       0x10    // 最近一次 I/O 出错
+
 // 高速缓存
 typedef struct buffer_t {
     void *data;         // 数据区
@@ -17,18 +23,69 @@ typedef struct buffer_t {
     size_t count;       // 引用计数
     list_node_t hnode;  // 哈希表拉链节点
     list_node_t rnode;  // 空闲链表节点
-    mutexlock_t lock;   // 锁
-    bool dirty;         // 脏位，数据是否与磁盘不一致
-    bool valid;         // 有效位，数据是否有效
+    list_t waiters;     // 等待缓存解锁的任务
+    list_node_t dnode;  // 脏链表节点
+    u32 dirty_time;     // 变脏时的全局时间片
+    bool free;          // 是否位于空闲链表
+    bool hot;           // 是否为热块 (2Q 替换策略中位于 Am 队列)
+    u32 state;          // 缓存状态
 } buffer_t;
 
-// 读取设备号 dev_id 的第 block 块数据到高速缓存
+// 高速缓存统计信息
+typedef struct buffer_stat_t {
+    u32 buffers;        // 高速缓存个数
+    u32 dirty;          // 脏缓存个数
+    u32 lookups;        // 查找次数
+    u32 hits;           // 命中次数
+    u32 misses;         // 未命中次数
+    u32 evictions;      // 淘汰次数
+    u32 a1_evictions;   // 2Q：从 A1in 淘汰的次数
+    u32 am_evictions;   // 2Q：从 Am 淘汰的次数
+    u32 promotions;     // 2Q：命中 A1out 影子队列而直接进入 Am 的次数
+    u32 reclaims;       // 内存不足时回收的缓存页数
+    u32 reads;          // 从设备读取的块数
+    u32 writebacks;     // 写回设备的块数
+    u32 errors;         // I/O 失败的请求数
+    u32 waits;          // 因没有空闲缓存而阻塞的次数
+    u32 wait_time;      // 因没有空闲缓存而阻塞的总时间 (jiffies)
+} buffer_stat_t;
+
+// 读取设备号 dev_id 的第 block 块数据到高速缓存，读取失败返回 NULL
 buffer_t *bread(devid_t dev_id, size_t block);
 
+// 读取设备号 dev_id 从第 start 块开始的连续 count 块数据到高速缓存
+// 其中连续的无效缓存会合并为一次多扇区的设备请求，bufs 为 NULL 时读取后直接释放缓存
+// 读取失败的块在 bufs 中为 NULL，此时返回 EOF
+i32 bread_cluster(devid_t dev_id, size_t start, size_t count, buffer_t **bufs);
+
+// 异步预读设备号 dev_id 的第 block 块数据到高速缓存
+void bprefetch(devid_t dev_id, size_t block);
+
+// 读取设备号 dev_id 的第 block 块数据到高速缓存，并异步预读 ahead 数组中的 count 个块，读取失败返回 NULL
+buffer_t *breada(devid_t dev_id, size_t block, size_t *ahead, size_t count);
+
+// 将高速缓存 bf 标记为脏，由回写线程延迟写回
+void bdirty(buffer_t *bf);
+
 // 将高速缓存 bf 的数据写回设备对应区域
 void bwrite(buffer_t *bf);
 
 // 释放高速缓存 bf
 void brelse(buffer_t *bf);
 
+// 获取高速缓存统计信息
+void buffer_stat(buffer_stat_t *info);
+
+// 缓存加锁，如果缓存已被其它任务加锁 (例如 I/O 进行中)，则阻塞等待直到解锁
+void buffer_lock(buffer_t *bf);
+
+// 缓存解锁，并唤醒所有等待该缓存的任务
+void buffer_unlock(buffer_t *bf);
+
+// 等待缓存解锁 (即等待进行中的 I/O 完成)
+void buffer_wait(buffer_t *bf);
+
+// 将所有脏的高速缓存写回设备，仍有缓存写回失败时返回 EOF
+i32 bsync();
+
 #endif
\ No newline at end of file
@@ -0,0 +1,12 @@
+#ifndef XOS_BUILTIN_H
+#define XOS_BUILTIN_H
+
+// 内置的用户态工具，运行于用户态，只通过系统调用与内核交互
+
+// 打印高速缓存统计信息
+void bufstat_main();
+
+// 打印块设备 I/O 统计信息和延迟直方图
+void iostat_main();
+
+#endif
@@ -5,9 +5,24 @@
 #include <xos/task.h>
 #include <xos/list.h>
 
+// 扇区大小 512B
+#define SECTOR_SIZE 512
+
 // 设备名称长度
 #define DEV_NAMELEN 16
 
+// 块设备请求池容量
+#define DEV_REQUEST_NR 32
+
+// 块设备合并请求的最大扇区数
+#define DEV_MERGE_MAX 128
+
+// 设备数量
+#define DEV_NR 64
+
+// 块设备延迟直方图的桶数，第 i 个桶统计延迟在 [2^i, 2^(i+1)) 微秒的请求，最后一个桶包括更长的延迟
+#define DEV_HIST_NR 20
+
 // 设备类型 (例如字符设备、块设备等)
 typedef enum dev_type_t {
     DEV_NULL,   // 空设备
@@ -23,6 +38,14 @@ typedef enum dev_subtype_t {
     /* 块设备 */
     DEV_ATA_DISK,   // ATA 磁盘
     DEV_ATA_PART,   // ATA 磁盘分区
+    DEV_RAID,       // RAID-0 条带化虚拟磁盘
+    DEV_SATA_DISK,  // SATA 磁盘 (AHCI)
+    DEV_SATA_PART,  // SATA 磁盘分区
+    DEV_VIRTIO_DISK,// virtio 块设备
+    DEV_VIRTIO_PART,// virtio 块设备分区
+    DEV_RAMDISK,    // 内存虚拟磁盘
+    DEV_ZRAM,       // 压缩内存虚拟磁盘
+    DEV_CACHE,      // 写回缓存虚拟磁盘
 } dev_subtype_t;
 
 // 设备控制命令
@@ -30,6 +53,9 @@ typedef enum dev_cmd_t {
     DEV_CMD_NULL,           // 空命令
     DEV_CMD_SECTOR_START,   // 获取设备扇区的起始 LBA
     DEV_CMD_SECTOR_COUNT,   // 获取设备扇区的数量
+    DEV_CMD_SECTOR_MAX,     // 获取设备单次请求的最大扇区数
+    DEV_CMD_SCHEDULER,      // 设置块设备的 I/O 调度算法 (由设备层处理，args 为 iosched_type_t)
+    DEV_CMD_QUEUE_DEPTH,    // 设置块设备同时执行的最大请求数 (由设备层处理，args 为请求数)
 } dev_cmd_t;
 
 // 块设备请求类型
@@ -38,6 +64,8 @@ typedef enum req_type_t {
     REQ_WRITE,  // 块设备写
 } req_type_t;
 
+struct iosched_t;
+
 // 块设备请求
 typedef struct request_t {
     devid_t dev_id;     // 请求设备号
@@ -47,7 +75,18 @@ typedef struct request_t {
     i32 flags;          // 特殊标志
     void *buf;          // 缓冲区
     task_t *task;       // 请求进程
+    bool started;       // 是否已经开始执行
     list_node_t node;   // 请求列表节点
+    list_node_t fnode;  // deadline 调度算法的 FIFO 列表节点
+    u32 deadline;       // deadline 调度算法的截止时间 (jiffies)
+    struct request_t *next; // 合并到同一次设备操作中的下一个请求 (按照 LBA 顺序)
+    size_t total;       // 合并后的扇区总数 (仅对合并后的首个请求有效)
+    bool done;          // 请求是否已经完成
+    i32 ret;            // 请求的执行结果
+    void (*callback)(struct request_t *req); // 请求完成时的回调函数
+    void *data;         // 回调函数使用的私有数据
+    u32 submit_time;    // 提交请求的时刻 (微秒)
+    u32 start_time;     // 设备开始执行请求的时刻 (微秒)
 } request_t;
 
 // 磁头寻道方向
@@ -57,6 +96,20 @@ typedef enum dev_direction_t {
 } dev_direction_t;
 
 
+// 块设备 I/O 统计信息，分区的请求转换为对磁盘的请求后统计在磁盘上
+typedef struct dev_stat_t {
+    char name[DEV_NAMELEN];     // 设备名
+    u32 ios[2];                 // 完成的读/写请求数
+    u32 sectors[2];             // 读/写的扇区数
+    u32 merges[2];              // 合并到相邻请求中的读/写请求数
+    u32 errors;                 // 失败的请求数
+    u32 queued;                 // 已提交但尚未完成的请求数
+    u32 max_queued;             // 已提交但尚未完成的最大请求数
+    u32 busy;                   // 设备有请求正在执行的总时间 (毫秒)
+    u32 latency[DEV_HIST_NR];   // 请求从提交到完成的延迟直方图 (包括排队时间)
+    u32 service[DEV_HIST_NR];   // 请求从设备开始执行到完成的延迟直方图
+} dev_stat_t;
+
 // 虚拟设备
 typedef struct dev_t {
     char name[DEV_NAMELEN];     // 设备名
@@ -67,6 +120,17 @@ typedef struct dev_t {
     void *dev;                  // 具体设备位置
     list_t request_list;        // 块设备请求列表
     dev_direction_t direction;  // 磁盘寻道方向
+    struct iosched_t *sched;    // I/O 调度器
+    list_t fifo_list[2];        // deadline 调度算法的读/写 FIFO 列表
+    request_t *requests;        // 块设备请求池
+    list_t free_requests;       // 空闲请求列表
+    list_t request_waiters;     // 等待空闲请求的任务列表
+    size_t depth;               // 同时执行的最大请求数
+    size_t inflight;            // 正在执行的请求数
+    bool plugged;               // 是否蓄流 (暂不执行新提交的请求)
+    dev_stat_t stat;            // I/O 统计信息
+    u32 busy_since;             // 设备开始忙碌的时刻 (微秒)
+    u32 busy_us;                // 忙碌时间中不足一毫秒的部分 (微秒)
 
     // 控制设备
     i32 (*ioctl)(void *dev, dev_cmd_t cmd, void *args, i32 flags);
@@ -74,6 +138,8 @@ typedef struct dev_t {
     i32 (*read)(void *dev, void *buf, size_t count, size_t idx, i32 flags);
     // 写设备
     i32 (*write)(void *dev, void *buf, size_t count, size_t idx, i32 flags);
+    // 开始执行块设备请求 (异步)，完成后调用 request_complete()，立即失败时返回 EOF
+    i32 (*request)(void *dev, request_t *req);
 } dev_t;
 
 // 安装设备
@@ -83,6 +149,9 @@ devid_t dev_install(dev_type_t type, dev_subtype_t subtype, void *dev, char *nam
 // 根据设备具体类型查找该类型的第 idx 个设备
 dev_t *dev_find(dev_subtype_t subtype, size_t idx);
 
+// 根据设备名查找设备，没有则返回 NULL
+dev_t *dev_find_name(char *name);
+
 // 根据设备号查找设备
 dev_t *dev_get(devid_t dev_id);
 
@@ -95,7 +164,38 @@ i32 dev_read(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags);
 // 写设备
 i32 dev_write(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags);
 
-// 块设备请求
-void dev_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags, req_type_t type);
+// 块设备请求，等待请求完成后返回，成功返回 0，失败返回 EOF
+i32 dev_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags, req_type_t type);
+
+// 提交块设备请求，不等待请求完成，返回请求句柄
+// 如果设置了回调函数 callback，则请求完成时 (通常位于中断处理中) 调用，之后请求自动释放，返回的句柄不再有效
+// 否则需要调用 wait_request() 等待请求完成并释放请求
+request_t *submit_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags, 
+                          req_type_t type, void (*callback)(request_t *req), void *data);
+
+// 与 submit_request() 相同，但是设备的请求池已耗尽时不阻塞，直接返回 NULL，可以在中断处理中调用
+request_t *try_submit_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags, 
+                              req_type_t type, void (*callback)(request_t *req), void *data);
+
+// 等待请求 req 完成并释放请求，成功返回 0，失败返回 EOF
+i32 wait_request(request_t *req);
+
+// 设备蓄流，之后提交的请求暂不执行，以便与随后提交的相邻请求合并为一次设备操作
+void dev_plug(devid_t dev_id);
+
+// 解除设备蓄流，开始执行蓄流期间提交的请求
+void dev_unplug(devid_t dev_id);
+
+// 为块设备注册异步请求处理函数，设备完成请求后需要调用 request_complete()
+void dev_install_request(devid_t dev_id, void *request);
+
+// 设备完成请求 req 后调用 (通常位于中断处理中)，ret 为执行结果
+void request_complete(request_t *req, i32 ret);
+
+// 获取合并后的请求 req 中第 sector 个扇区对应的缓冲区
+void *request_buffer(request_t *req, size_t sector);
+
+// 获取块设备 dev_id 的 I/O 统计信息，设备号无效或者不是块设备时返回 EOF
+i32 dev_stat(devid_t dev_id, dev_stat_t *stat);
 
 #endif
\ No newline at end of file
@@ -46,6 +46,9 @@ typedef struct inode_t {
     time_t ctime;           // create time
     list_node_t node;       // inode 链表节点
     devid_t mount;          // 安装设备
+    size_t ra_next;         // 预读：预期顺序访问的下一个逻辑块
+    size_t ra_window;       // 预读：预读窗口的块数
+    size_t ra_end;          // 预读：已提交预读的逻辑块上界 (不含)
 } inode_t;
 
 // 磁盘中的 superblock 格式 (可用于磁盘和内存)
@@ -82,10 +85,14 @@ typedef struct dentry_t {
 /* super.c */
 // 在超级块表中查找设备号 dev_id 对应的超级块，没有则返回 NULL
 superblock_t *get_superblock(devid_t dev_id);
-// 读取设备号 dev_id 对应的超级块
+// 读取设备号 dev_id 对应的超级块，失败返回 NULL
 superblock_t *read_superblock(devid_t dev_id);
 
 
+/* mkfs.c */
+// 将设备 dev_id 格式化为 MINIX 文件系统，只包含根目录，失败返回 EOF
+i32 minix_mkfs(devid_t dev_id);
+
 /* fsmap.c */
 // 分配一个文件块并返回块号 (从 1 开始计数)
 size_t balloc(devid_t dev_id);
@@ -96,13 +103,14 @@ size_t ialloc(devid_t dev_id);
 // 释放一个文件系统 inode (inode 号从 1 开始计数)
 void ifree(devid_t dev_id, size_t nr);
 // 获取 inode 索引的第 nr 个块对应的块号
-// 如果该块不存在且 create 为 true，则创建
+// 如果该块不存在且 create 为 true，则创建；如果 create 为 false，则按顺序访问情况进行预读
+// 块不存在或者读取索引块失败时返回 0
 size_t bmap(inode_t *inode, size_t nr, bool create);
 
 /* inode.c */
 // 获取根目录对应的 inode (约定 inode 池的第一个 inode 用于存放根目录对应的 inode)
 inode_t *get_root_inode();
-// 获取设备的第 nr 个 inode
+// 获取设备的第 nr 个 inode，读取失败返回 NULL
 inode_t *iget(devid_t dev_id, size_t nr);
 // 释放 inode 会 inode 池
 void iput(inode_t *inode);
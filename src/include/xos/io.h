@@ -5,8 +5,13 @@
 
 u8  inb(u32 port); // 获取外设端口 port 的一个字节数据
 u16 inw(u32 port); // 获取外设端口 port 的一个字数据
+u32 inl(u32 port); // 获取外设端口 port 的一个双字数据
 
 void outb(u32 port, u8  value); // 向外设端口 port 输入一个字节数据 value
 void outw(u32 prot, u16 value); // 向外设端口 port 输入一个字数据   value
+void outl(u32 port, u32 value); // 向外设端口 port 输入一个双字数据 value
+
+void insw(u32 port, void *buf, u32 count);  // 从外设端口 port 连续获取 count 个字数据到 buf
+void outsw(u32 port, void *buf, u32 count); // 向外设端口 port 连续输入 buf 中的 count 个字数据
 
 #endif
\ No newline at end of file
@@ -0,0 +1,32 @@
+#ifndef XOS_IOSCHED_H
+#define XOS_IOSCHED_H
+
+#include <xos/types.h>
+#include <xos/device.h>
+
+// I/O 调度算法类型
+typedef enum iosched_type_t {
+    IOSCHED_NOOP,       // 先来先服务，适用于没有寻道开销的设备
+    IOSCHED_SCAN,       // 电梯调度算法 (SCAN)，双向扫描
+    IOSCHED_CSCAN,      // 循环扫描算法 (C-SCAN)，单向扫描
+    IOSCHED_DEADLINE,   // 截止时间调度算法，在 C-SCAN 的基础上保证请求的最长等待时间
+    IOSCHED_NR,         // I/O 调度算法数量
+} iosched_type_t;
+
+// I/O 调度器，管理块设备 dev 的请求列表
+typedef struct iosched_t {
+    char *name;         // 调度器名称
+    // 将请求 req 加入调度队列
+    void (*add)(dev_t *dev, request_t *req);
+    // 将请求 req 移出调度队列
+    void (*remove)(dev_t *dev, request_t *req);
+    // 请求 new 取代调度队列中的请求 old (例如向前合并时)
+    void (*replace)(dev_t *dev, request_t *old, request_t *new);
+    // 获取正在执行的请求 req 完成后的下一个请求，没有则返回 NULL
+    request_t *(*next)(dev_t *dev, request_t *req);
+} iosched_t;
+
+// 获取 type 类型的 I/O 调度器，类型无效时返回 NULL
+iosched_t *iosched_get(iosched_type_t type);
+
+#endif
@@ -0,0 +1,17 @@
+#ifndef XOS_LZ4_H
+#define XOS_LZ4_H
+
+#include <xos/types.h>
+
+// 压缩时哈希表的位数和项数，哈希表由调用者提供 (内核栈较小)
+#define LZ4_HASH_BITS 10
+#define LZ4_HASH_SIZE (1 << LZ4_HASH_BITS)
+
+// 使用 LZ4 块格式压缩 src 中的 size 字节 (不超过 64K) 到 dst，table 为 LZ4_HASH_SIZE 项的哈希表
+// 返回压缩后的字节数，压缩结果超过 capacity 时返回 0
+size_t lz4_compress(const void *src, size_t size, void *dst, size_t capacity, u16 *table);
+
+// 解压 src 中 size 字节的 LZ4 块到 dst，返回解压后的字节数，数据损坏或超过 capacity 时返回 EOF
+i32 lz4_decompress(const void *src, size_t size, void *dst, size_t capacity);
+
+#endif
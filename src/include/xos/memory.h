@@ -9,10 +9,18 @@
 #define MEMORY_ALLOC_BASE   0x100000    // 32 位可用内存起始地址为 1M
 #define KERNEL_VMAP_BITS    0x6000      // 内核虚拟内存空间位图起始地址
 #define KERNEL_MEMORY_SIZE  0x1000000   // 内核占用的内存大小 16M
-#define KERNEL_BUFFER_BASE  0x800000    // 内核高速缓冲起始地址 8M
-#define KERNEL_BUFFER_SIZE  0x400000    // 内核高速缓冲大小 4M
-#define KERNEL_RAMDISK_BASE 0xC00000    // 内核虚拟磁盘起始地址 12M
-#define KERNEL_RAMDISK_SIZE 0x400000    // 内核虚拟磁盘大小 4M
+// 内核虚拟磁盘大小，默认 4M，编译时通过 -DKERNEL_RAMDISK_SIZE=... 指定 (按页对齐，为 0 表示不保留)
+#ifndef KERNEL_RAMDISK_SIZE
+#define KERNEL_RAMDISK_SIZE 0x400000
+#endif
+#if KERNEL_RAMDISK_SIZE > 0x800000
+#error "kernel ramdisk must leave at least 8M kernel memory"
+#endif
+// 内核虚拟磁盘位于内核内存的末尾，默认起始地址 12M
+#define KERNEL_RAMDISK_BASE (KERNEL_MEMORY_SIZE - KERNEL_RAMDISK_SIZE)
+#define KERNEL_PAGES_LOW    256         // 内核空闲页低水位线 (1M)，低于该值时回收内存
+
+#define SHRINKER_NR 4   // 内存回收函数的最大个数
 
 #define USER_MEMORY_TOP     0x8800000   // 用户虚拟内存的最高地址 136M
 #define USER_STACK_TOP  USER_MEMORY_TOP // 用户栈顶地址 136M
@@ -80,6 +88,21 @@ u32 kalloc_page(u32 count);
 // 释放 count 个连续的内核页
 void kfree_page(u32 vaddr, u32 count);
 
+// 将物理地址 paddr 开始的 size 字节设备内存 (MMIO) 映射到内核虚拟内存，返回对应的虚拟地址
+u32 kmap_mmio(u32 paddr, u32 size);
+
+// 启动时加载到内核虚拟磁盘区域的 initrd 大小，没有则为 0
+u32 get_initrd_size();
+
+// 内核空闲页数
+u32 kernel_free_pages();
+
+// 内存回收函数，尝试回收 count 个内核页，返回实际回收的页数
+typedef u32 (*shrinker_t)(u32 count);
+
+// 注册内存回收函数，内核空闲页不足时会被调用
+void register_shrinker(shrinker_t shrinker);
+
 // 初始化页表项，设置为指定的页索引 | U | W | P
 void page_entry_init(page_entry_t *entry, u32 index);
 
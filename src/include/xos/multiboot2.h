@@ -7,8 +7,9 @@
 #define MULTIBOOT2_MAGIC 0x36d76289
 
 // multiboot2 tag 类型
-#define MULTIBOOT2_TAG_TYPE_END  0
-#define MULTIBOOT2_TAG_TYPE_MMAP 6
+#define MULTIBOOT2_TAG_TYPE_END    0
+#define MULTIBOOT2_TAG_TYPE_MODULE 3
+#define MULTIBOOT2_TAG_TYPE_MMAP   6
 
 // multiboot2 memory-map 的类型
 #define MULTIBOOT2_MEMORY_AVAILABLE 1
@@ -40,5 +41,14 @@ typedef struct multiboot2_tag_mmap_t {
     multiboot2_mmap_entry_t entries[0];
 } multiboot2_tag_mmap_t;
 
+// multiboot2 module tag
+typedef struct multiboot2_tag_module_t {
+    u32 type;           // tag 的类型（为 3）
+    u32 size;           // tag 的大小
+    u32 mod_start;      // 模块的起始物理地址
+    u32 mod_end;        // 模块的结束物理地址
+    char cmdline[0];    // 模块的命令行
+} multiboot2_tag_module_t;
+
 
 #endif
\ No newline at end of file
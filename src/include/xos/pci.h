@@ -0,0 +1,67 @@
+#ifndef XOS_PCI_H
+#define XOS_PCI_H
+
+#include <xos/types.h>
+#include <xos/list.h>
+
+// PCI 配置空间寄存器偏移
+#define PCI_CONF_VENDOR     0x00    // 厂商 ID
+#define PCI_CONF_DEVICE     0x02    // 设备 ID
+#define PCI_CONF_COMMAND    0x04    // 命令寄存器
+#define PCI_CONF_STATUS     0x06    // 状态寄存器
+#define PCI_CONF_REVISION   0x08    // 修订号
+#define PCI_CONF_CLASS      0x08    // 类代码 (高 24 位)
+#define PCI_CONF_HEADER     0x0C    // 头部类型
+#define PCI_CONF_BASE_ADDR0 0x10    // 基址寄存器 0
+#define PCI_CONF_SUBSYSTEM  0x2C    // 子系统 ID
+#define PCI_CONF_INTERRUPT  0x3C    // 中断线
+
+// PCI 命令寄存器
+#define PCI_COMMAND_IO      0x0001  // 允许响应 I/O 空间访问
+#define PCI_COMMAND_MEMORY  0x0002  // 允许响应内存空间访问
+#define PCI_COMMAND_MASTER  0x0004  // 允许作为总线主控 (DMA)
+
+// PCI 基址寄存器类型
+#define PCI_BAR_TYPE_MEM    0       // 内存空间
+#define PCI_BAR_TYPE_IO     1       // I/O 空间
+
+#define PCI_BAR_NR 6    // 基址寄存器的数量
+
+// PCI 基址寄存器
+typedef struct pci_bar_t {
+    u32 iobase;     // 基址
+    u32 size;       // 大小
+} pci_bar_t;
+
+// PCI 设备
+typedef struct pci_device_t {
+    list_node_t node;   // 设备链表节点
+    u8 bus;             // 总线号
+    u8 dev;             // 设备号
+    u8 func;            // 功能号
+    u16 vendorid;       // 厂商 ID
+    u16 deviceid;       // 设备 ID
+    u8 revision;        // 修订号
+    u32 classcode;      // 类代码 (基类 << 16 | 子类 << 8 | 编程接口)
+    u8 irq;             // 中断线 (IRQ 号)
+} pci_device_t;
+
+// 读取 PCI 设备 device 配置空间中偏移为 offset 的双字
+u32 pci_inl(pci_device_t *device, u8 offset);
+
+// 写入 PCI 设备 device 配置空间中偏移为 offset 的双字
+void pci_outl(pci_device_t *device, u8 offset, u32 value);
+
+// 根据厂商 ID 和设备 ID 查找第 idx 个 PCI 设备，没有则返回 NULL
+pci_device_t *pci_find_device(u16 vendorid, u16 deviceid, size_t idx);
+
+// 根据基类和子类查找第 idx 个 PCI 设备，没有则返回 NULL
+pci_device_t *pci_find_class(u8 base, u8 sub, size_t idx);
+
+// 获取 PCI 设备 device 的第 idx 个 type 类型的基址寄存器，成功返回 0，失败返回 EOF
+i32 pci_find_bar(pci_device_t *device, pci_bar_t *bar, size_t idx, i32 type);
+
+// 允许 PCI 设备 device 作为总线主控进行 DMA
+void pci_enable_busmaster(pci_device_t *device);
+
+#endif
@@ -0,0 +1,33 @@
+#ifndef XOS_RAID_H
+#define XOS_RAID_H
+
+#include <xos/types.h>
+#include <xos/device.h>
+#include <xos/list.h>
+
+// 条带化设备的最大成员数量
+#define RAID_MEMBER_NR 4
+// 条带化设备的最小条带大小 (扇区数)，限制一次请求拆分出的子请求数量
+#define RAID_CHUNK_MIN 8
+
+// RAID-0 条带化虚拟块设备，按照条带 (chunk) 轮流将扇区分布到各个成员设备
+typedef struct raid_t {
+    char name[8];                       // 设备名称
+    devid_t dev_id;                     // 设备号
+    devid_t members[RAID_MEMBER_NR];    // 成员设备号
+    size_t count;                       // 成员设备数量
+    size_t chunk;                       // 条带大小 (扇区数)
+    size_t member_sectors;              // 每个成员设备使用的扇区数 (条带大小的整数倍)
+    request_t *request;                 // 正在执行的请求
+    size_t pending;                     // 正在执行的请求尚未完成的子请求数量
+    i32 ret;                            // 正在执行的请求的执行结果
+    request_t *cursor;                  // 下一个子请求所在的合并链表中的请求
+    size_t offset;                      // 下一个子请求在 cursor 中的扇区偏移
+    size_t done;                        // 已提交子请求的扇区数
+    list_node_t node;                   // 成员设备请求池耗尽时，等待 raid 线程继续提交子请求
+} raid_t;
+
+// 使用 count 个成员设备 members 创建条带大小为 chunk 个扇区的条带化设备 name，失败返回 EOF
+devid_t raid_install(char *name, devid_t *members, size_t count, size_t chunk);
+
+#endif
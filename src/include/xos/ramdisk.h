@@ -0,0 +1,20 @@
+#ifndef XOS_RAMDISK_H
+#define XOS_RAMDISK_H
+
+#include <xos/types.h>
+#include <xos/device.h>
+
+// 支持的内存虚拟磁盘数量
+#define RAMDISK_NR 4
+
+// 内存虚拟磁盘，使用一段恒等映射的内核内存作为磁盘扇区
+typedef struct ramdisk_t {
+    char name[8];   // 磁盘名称
+    u8 *start;      // 内存起始地址
+    size_t count;   // 扇区数量
+} ramdisk_t;
+
+// 使用起始地址为 start、大小为 size 字节的内存创建虚拟磁盘 name，失败返回 EOF
+devid_t ramdisk_install(char *name, void *start, size_t size);
+
+#endif
@@ -14,6 +14,7 @@ char *strrchr(const char *str, int ch);    // finds the last occurrence of a cha
 int memcmp(const void *lhs, const void *rhs, size_t count); // compares two buffers
 void *memset(void *dest, int ch, size_t count);          // fills a buffer with a character
 void *memcpy(void *dest, const void *src, size_t count); // copies one buffer to another
+void *memmove(void *dest, const void *src, size_t count);// copies one buffer to another, the buffers may overlap
 void *memchr(const void *ptr, int ch, size_t count);     // searches an array for the first occurrence of a character
 
 #endif
\ No newline at end of file
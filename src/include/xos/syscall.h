@@ -2,6 +2,8 @@
 #define XOS_SYSCALL_H
 
 #include <xos/types.h>
+#include <xos/buffer.h>
+#include <xos/device.h>
 
 // #include <asm/unistd_32.h>
 
@@ -17,11 +19,14 @@ typedef enum syscall_t {
     SYS_WAITPID = 7,
     SYS_TIME    = 13,
     SYS_GETPID  = 20,
+    SYS_SYNC    = 36,
     SYS_BRK     = 45,
     SYS_UMASK   = 60,
     SYS_GETPPID = 64,
     SYS_YIELD   = 158,
     SYS_SLEEP   = 162,
+    SYS_BUFSTAT = 200,
+    SYS_IOSTAT  = 201,
 } syscall_t;
 
 // 检测系统调用号是否合法
@@ -55,6 +60,11 @@ time_t  time();
 // getpid() returns the process ID (PID) of the calling process.
 pid_t   getpid();
 
+// sync() causes all pending modifications to filesystem metadata and 
+// cached file data to be written to the underlying filesystems.
+// On success, zero is returned. On error (some data could not be written), EOF is returned.
+i32     sync();
+
 // brk() change the location of the program break, which defines the 
 // end of the process's data segment.
 i32     brk(void *addr);
@@ -76,4 +86,12 @@ void    yield();
 // the process.
 void    sleep(u32 ms);
 
+// bufstat() copies the statistics of the buffer cache into the buffer 
+// pointed to by info.
+i32     bufstat(buffer_stat_t *info);
+
+// iostat() copies the I/O statistics of the block device dev_id into the 
+// buffer pointed to by stat, and returns EOF if dev_id is not a block device.
+i32     iostat(devid_t dev_id, dev_stat_t *stat);
+
 #endif
\ No newline at end of file
@@ -74,6 +74,9 @@ void rtc_init();
 // 开始蜂鸣
 void start_beep();
 
+// 获取系统启动以来的微秒数 (约 71 分钟回绕)
+u32 clock_us();
+
 // 初始化 PIT
 void pit_init();
 
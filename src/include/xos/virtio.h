@@ -0,0 +1,85 @@
+#ifndef XOS_VIRTIO_H
+#define XOS_VIRTIO_H
+
+#include <xos/types.h>
+#include <xos/device.h>
+#include <xos/ata.h>
+
+// 支持的 virtio 块设备数量
+#define VIRTIO_BLK_NR 4
+// 每个块设备同时执行的最大请求数 (每个请求占用一个命令槽)
+#define VIRTIO_SLOT_NR 32
+// 每个请求的间接描述符数量 (请求头 + 数据缓冲区 + 状态字节)
+#define VIRTIO_DESC_NR (DEV_MERGE_MAX + 2)
+
+// 虚拟队列描述符
+typedef struct vring_desc_t {
+    u64 addr;   // 缓冲区的物理地址
+    u32 len;    // 缓冲区的字节数
+    u16 flags;  // 标志
+    u16 next;   // 描述符链中下一个描述符的索引
+} _packed vring_desc_t;
+
+// 可用环，驱动程序将描述符链的首个描述符索引放入该环中
+typedef struct vring_avail_t {
+    u16 flags;  // 标志
+    u16 idx;    // 驱动程序下一个写入的位置 (不取模)
+    u16 ring[]; // 描述符索引，之后是 used_event
+} vring_avail_t;
+
+// 已用环元素
+typedef struct vring_used_elem_t {
+    u32 id;     // 已完成的描述符链的首个描述符索引
+    u32 len;    // 设备写入的字节数
+} vring_used_elem_t;
+
+// 已用环，设备将完成的描述符链放入该环中
+typedef struct vring_used_t {
+    u16 flags;  // 标志
+    u16 idx;    // 设备下一个写入的位置 (不取模)
+    vring_used_elem_t ring[]; // 已完成的描述符链，之后是 avail_event
+} vring_used_t;
+
+// virtio 块设备请求头
+typedef struct virtio_blk_header_t {
+    u32 type;       // 请求类型
+    u32 reserved;
+    u64 sector;     // 起始扇区
+} _packed virtio_blk_header_t;
+
+// 命令槽，保存请求的间接描述符表、请求头和状态
+typedef struct virtio_blk_slot_t {
+    vring_desc_t table[VIRTIO_DESC_NR]; // 间接描述符表
+    virtio_blk_header_t header;         // 请求头
+    volatile u8 status;                 // 设备写入的请求状态
+    request_t *request;                 // 命令槽正在执行的请求，同步请求为 NULL
+} virtio_blk_slot_t;
+
+// virtio 块设备分区
+typedef struct virtio_partition_t {
+    char name[8];               // 分区名称
+    struct virtio_blk_t *blk;   // 分区所在的块设备
+    PARTITION_FS system;        // 分区类型 (表示文件系统)
+    u32 start_lba;              // 分区起始扇区的 LBA
+    size_t count;               // 分区占有的扇区数
+} virtio_partition_t;
+
+// virtio 块设备 (传统 PCI 接口)
+typedef struct virtio_blk_t {
+    char name[8];               // 设备名称
+    u16 iobase;                 // I/O 寄存器基址
+    u8 irq;                     // 中断线
+    size_t total_lba;           // 可用扇区的数量
+    bool event_idx;             // 是否使用事件索引抑制通知和中断
+    u16 size;                   // 虚拟队列大小 (描述符数量)
+    u16 depth;                  // 使用的命令槽数量 (同时执行的最大请求数)
+    u32 issued;                 // 正在执行请求的命令槽位图
+    vring_desc_t *desc;         // 描述符表
+    vring_avail_t *avail;       // 可用环
+    vring_used_t *used;         // 已用环
+    u16 last_used;              // 驱动程序已处理的已用环位置
+    virtio_blk_slot_t *slots;   // 命令槽
+    virtio_partition_t parts[ATA_PARTITION_NR]; // 分区
+} virtio_blk_t;
+
+#endif
@@ -0,0 +1,45 @@
+#ifndef XOS_ZRAM_H
+#define XOS_ZRAM_H
+
+#include <xos/types.h>
+#include <xos/list.h>
+#include <xos/device.h>
+
+// 压缩块的大小 (与文件系统块大小相同)
+#define ZRAM_BLOCK_SIZE 1024
+// 压缩对象的大小粒度，同一页中只存放同一大小类别的对象
+#define ZRAM_CLASS_SIZE 64
+// 大小类别的数量
+#define ZRAM_CLASS_NR (ZRAM_BLOCK_SIZE / ZRAM_CLASS_SIZE)
+
+// 存放压缩对象的页
+typedef struct zram_page_t {
+    list_node_t node;   // 所在大小类别的页链表节点
+    u32 addr;           // 页地址
+    u8 class;           // 大小类别
+    u8 used;            // 已使用的对象数量
+    u32 bitmap[2];      // 对象的占用位图 (每页至多 64 个对象)
+} zram_page_t;
+
+// 块句柄，page 为 NULL 表示全零块 (所有全零块共享，不占用内存)
+typedef struct zram_handle_t {
+    zram_page_t *page;  // 压缩对象所在的页
+    u16 index;          // 压缩对象在页中的序号
+    u16 size;           // 压缩后的字节数，等于 ZRAM_BLOCK_SIZE 表示未压缩
+} zram_handle_t;
+
+// 压缩内存虚拟磁盘
+typedef struct zram_t {
+    char name[8];                       // 磁盘名称
+    size_t blocks;                      // 块数量
+    zram_handle_t *table;               // 块句柄表
+    list_t classes[ZRAM_CLASS_NR];      // 每个大小类别的页链表，有空闲对象的页位于链表头部
+    u8 *block;                          // 读写不完整的块时使用的缓冲区
+    u8 *compressed;                     // 压缩结果缓冲区
+    u16 *hash;                          // 压缩使用的哈希表
+    size_t pages;                       // 占用的页数
+    size_t stored;                      // 压缩后的总字节数
+    size_t zeros;                       // 全零块的数量
+} zram_t;
+
+#endif
@@ -0,0 +1,575 @@
+#include <xos/ahci.h>
+#include <xos/stdio.h>
+#include <xos/interrupt.h>
+#include <xos/memory.h>
+#include <xos/string.h>
+#include <xos/assert.h>
+#include <xos/debug.h>
+#include <xos/pci.h>
+#include <xos/stdlib.h>
+
+// AHCI 控制器的 PCI 类代码
+#define PCI_CLASS_STORAGE   0x01    // 大容量存储控制器
+#define PCI_SUBCLASS_SATA   0x06    // SATA 控制器
+#define PCI_PROGIF_AHCI     0x01    // AHCI 编程接口
+#define AHCI_ABAR           5       // HBA 寄存器 (ABAR) 所在的基址寄存器
+
+// 主机能力寄存器
+#define AHCI_CAP_NCS(cap)   ((((cap) >> 8) & 0x1f) + 1) // 每个端口的命令槽数量
+#define AHCI_CAP_SNCQ       (1 << 30)   // 支持原生命令队列
+
+// 全局主机控制寄存器
+#define AHCI_GHC_IE         (1 << 1)    // 允许中断
+#define AHCI_GHC_AE         (1 << 31)   // 启用 AHCI 模式
+
+// 端口命令和状态寄存器
+#define AHCI_PxCMD_ST       (1 << 0)    // 开始处理命令列表
+#define AHCI_PxCMD_FRE      (1 << 4)    // 允许接收 FIS
+#define AHCI_PxCMD_FR       (1 << 14)   // FIS 接收正在运行
+#define AHCI_PxCMD_CR       (1 << 15)   // 命令列表正在运行
+
+// 端口中断状态寄存器
+#define AHCI_PxIS_DHRS      (1 << 0)    // 收到设备到主机的寄存器 FIS
+#define AHCI_PxIS_PSS       (1 << 1)    // 收到 PIO 设置 FIS
+#define AHCI_PxIS_SDBS      (1 << 3)    // 收到设置设备位 FIS (NCQ 命令完成)
+#define AHCI_PxIS_IFS       (1 << 27)   // 接口致命错误
+#define AHCI_PxIS_HBDS      (1 << 28)   // 主机总线数据错误
+#define AHCI_PxIS_HBFS      (1 << 29)   // 主机总线致命错误
+#define AHCI_PxIS_TFES      (1 << 30)   // 任务文件错误 (状态寄存器 ERR 位)
+#define AHCI_PxIS_ERROR     (AHCI_PxIS_IFS | AHCI_PxIS_HBDS | AHCI_PxIS_HBFS | AHCI_PxIS_TFES)
+
+// 任务文件数据寄存器 (低字节为状态寄存器)
+#define AHCI_TFD_ERR        0x01        // 错误
+#define AHCI_TFD_DRQ        0x08        // 数据请求
+#define AHCI_TFD_BSY        0x80        // 驱动器忙
+
+// SATA 状态和控制寄存器
+#define AHCI_SSTS_DET       0x0f        // 设备检测
+#define AHCI_DET_PRESENT    3           // 检测到设备并且已经建立通信
+#define AHCI_SCTL_DET_INIT  1           // 执行通信复位 (COMRESET)
+
+// 设备签名
+#define AHCI_SIG_ATA        0x00000101  // SATA 磁盘
+
+// 命令头标志
+#define AHCI_CMD_WRITE      (1 << 6)    // 数据传输方向为写入设备
+
+// FIS 类型
+#define AHCI_FIS_H2D        0x27        // 主机到设备的寄存器 FIS
+#define AHCI_FIS_COMMAND    0x80        // 命令 FIS 标志
+
+// ATA 命令
+#define AHCI_CMD_READ_DMA_EXT   0x25    // 48 位 LBA 的 DMA 读命令
+#define AHCI_CMD_WRITE_DMA_EXT  0x35    // 48 位 LBA 的 DMA 写命令
+#define AHCI_CMD_READ_FPDMA     0x60    // 原生命令队列读命令 (READ FPDMA QUEUED)
+#define AHCI_CMD_WRITE_FPDMA    0x61    // 原生命令队列写命令 (WRITE FPDMA QUEUED)
+#define AHCI_CMD_IDENTIFY       0xEC    // 识别命令
+#define AHCI_DEVICE_LBA         0x40    // 设备寄存器的 LBA 模式位
+
+// 识别信息中的字索引
+#define AHCI_ID_QUEUE_DEPTH     75      // 队列深度减一 (0~4 位)
+#define AHCI_ID_SATA_CAP        76      // SATA 能力，第 8 位表示支持 NCQ
+#define AHCI_ID_COMMAND_SET     83      // 支持的命令集，第 10 位表示支持 48 位 LBA
+#define AHCI_ID_TOTAL_LBA       60      // 28 位 LBA 的可用扇区数 (60 ~ 61)
+#define AHCI_ID_TOTAL_LBA48     100     // 48 位 LBA 的可用扇区数 (100 ~ 103)
+
+#define AHCI_RETRY_MAX      3       // 请求出错后的最大重试次数
+#define AHCI_SPIN_MAX       1000000 // 轮询端口寄存器的最大次数
+
+// 命令表占用的页数
+#define AHCI_TABLE_PAGES div_round_up(sizeof(ahci_cmd_table_t) * AHCI_SLOT_NR, PAGE_SIZE)
+
+static ahci_hba_t *hba;                     // HBA 寄存器
+static ahci_disk_t disks[AHCI_DISK_NR];     // SATA 磁盘
+static size_t disk_count;                   // SATA 磁盘数量
+
+// 轮询端口寄存器 reg，直到 mask 对应的位全部等于 value，超时返回 EOF
+static i32 ahci_spin(volatile u32 *reg, u32 mask, u32 value) {
+    for (size_t i = 0; i < AHCI_SPIN_MAX; i++) {
+        if ((*reg & mask) == value) {
+            return 0;
+        }
+    }
+    return EOF;
+}
+
+// 停止端口处理命令列表和接收 FIS
+static void ahci_port_stop(ahci_port_t *port) {
+    port->cmd &= ~AHCI_PxCMD_ST;
+    ahci_spin(&port->cmd, AHCI_PxCMD_CR, 0);
+    port->cmd &= ~AHCI_PxCMD_FRE;
+    ahci_spin(&port->cmd, AHCI_PxCMD_FR, 0);
+}
+
+// 开始接收 FIS 和处理命令列表
+static void ahci_port_start(ahci_port_t *port) {
+    ahci_spin(&port->tfd, AHCI_TFD_BSY | AHCI_TFD_DRQ, 0);
+    port->cmd |= AHCI_PxCMD_FRE;
+    port->cmd |= AHCI_PxCMD_ST;
+}
+
+// 根据请求 req 的各个缓冲区构造命令槽 slot 的物理区域描述符表，返回描述符数量，失败返回 0
+static size_t ahci_prepare(ahci_disk_t *disk, u8 slot, request_t *req) {
+    ahci_prd_t *prd = disk->tables[slot].prdt;
+    size_t count = 0;
+
+    for (request_t *ptr = req; ptr; ptr = ptr->next) {
+        u32 addr = (u32)ptr->buf;
+        u32 len = ptr->count * SECTOR_SIZE;
+
+        // DMA 使用物理地址，缓冲区必须位于恒等映射的内核内存，并且按字对齐
+        if (addr + len > KERNEL_MEMORY_SIZE || (addr & 1)) {
+            return 0;
+        }
+
+        // 物理地址连续的缓冲区使用同一个描述符
+        if (count > 0 && prd[count - 1].dba + (prd[count - 1].dbc + 1) == addr) {
+            prd[count - 1].dbc += len;
+            continue;
+        }
+
+        assert(count < AHCI_PRD_NR);
+        prd[count].dba = addr;
+        prd[count].dbau = 0;
+        prd[count].reserved = 0;
+        prd[count].dbc = len - 1;
+        count++;
+    }
+    return count;
+}
+
+// 在命令槽 slot 中构造 ATA 命令 command，prds 为物理区域描述符数量
+static void ahci_build(ahci_disk_t *disk, u8 slot, u8 command, size_t lba, size_t count, size_t prds) {
+    ahci_cmd_header_t *header = &disk->cmds[slot];
+    ahci_cmd_table_t *table = &disk->tables[slot];
+    ahci_fis_h2d_t *fis = (ahci_fis_h2d_t *)table->cfis;
+    memset(fis, 0, sizeof(ahci_fis_h2d_t));
+
+    fis->type = AHCI_FIS_H2D;
+    fis->flags = AHCI_FIS_COMMAND;
+    fis->command = command;
+    fis->lba0 = lba & 0xff;
+    fis->lba1 = (lba >> 8) & 0xff;
+    fis->lba2 = (lba >> 16) & 0xff;
+    fis->lba3 = (lba >> 24) & 0xff;
+
+    switch (command) {
+    case AHCI_CMD_READ_FPDMA:
+    case AHCI_CMD_WRITE_FPDMA:
+        // NCQ 命令的扇区数量位于功能寄存器，扇区数量寄存器的 3~7 位为命令标签
+        fis->feature_low = count & 0xff;
+        fis->feature_high = (count >> 8) & 0xff;
+        fis->count_low = slot << 3;
+        fis->device = AHCI_DEVICE_LBA;
+        break;
+    case AHCI_CMD_READ_DMA_EXT:
+    case AHCI_CMD_WRITE_DMA_EXT:
+        fis->count_low = count & 0xff;
+        fis->count_high = (count >> 8) & 0xff;
+        fis->device = AHCI_DEVICE_LBA;
+        break;
+    default:
+        break;
+    }
+
+    header->flags = sizeof(ahci_fis_h2d_t) / 4;
+    if (command == AHCI_CMD_WRITE_FPDMA || command == AHCI_CMD_WRITE_DMA_EXT) {
+        header->flags |= AHCI_CMD_WRITE;
+    }
+    header->prdtl = prds;
+    header->prdbc = 0;
+}
+
+// 获取请求类型 type 对应的读写命令
+static u8 ahci_command(ahci_disk_t *disk, req_type_t type) {
+    if (disk->ncq) {
+        return type == REQ_READ ? AHCI_CMD_READ_FPDMA : AHCI_CMD_WRITE_FPDMA;
+    }
+    return type == REQ_READ ? AHCI_CMD_READ_DMA_EXT : AHCI_CMD_WRITE_DMA_EXT;
+}
+
+// 发出命令槽 slot 中的命令，NCQ 命令需要先设置对应的 SATA 活动位
+static void ahci_issue(ahci_disk_t *disk, u8 slot) {
+    u8 command = ((ahci_fis_h2d_t *)disk->tables[slot].cfis)->command;
+    if (command == AHCI_CMD_READ_FPDMA || command == AHCI_CMD_WRITE_FPDMA) {
+        disk->port->sact = 1 << slot;
+    }
+    disk->port->ci = 1 << slot;
+}
+
+// 同步执行命令槽 0 中的命令，轮询等待命令完成，成功返回 0，失败返回 EOF
+static i32 ahci_exec(ahci_disk_t *disk) {
+    ahci_port_t *port = disk->port;
+    ahci_issue(disk, 0);
+
+    i32 ret = 0;
+    for (size_t i = 0; port->ci & 1; i++) {
+        if ((port->is & AHCI_PxIS_ERROR) || i == AHCI_SPIN_MAX) {
+            ret = EOF;
+            break;
+        }
+    }
+
+    // 出错时需要重新启动端口，才能清除错误状态
+    if (ret < 0 || (port->tfd & AHCI_TFD_ERR)) {
+        LOGK("disk %s command error tfd 0x%x is 0x%x\n", disk->name, port->tfd, port->is);
+        ahci_port_stop(port);
+        port->serr = port->serr;
+        port->is = port->is;
+        ahci_port_start(port);
+        ret = EOF;
+    }
+    port->is = port->is;
+    return ret;
+}
+
+// 同步读写磁盘 disk 从第 lba 个扇区开始的 count 个扇区，只在没有异步请求时使用 (例如初始化时扫描分区)
+static i32 ahci_rw(ahci_disk_t *disk, void *buf, size_t count, size_t lba, req_type_t type) {
+    if (disk->issued || count == 0 || count > AHCI_PRD_NR) {
+        return EOF;
+    }
+
+    request_t req;
+    req.buf = buf;
+    req.count = count;
+    req.next = NULL;
+    size_t prds = ahci_prepare(disk, 0, &req);
+    if (prds == 0) {
+        return EOF;
+    }
+
+    // NCQ 命令的完成需要中断处理，同步读写使用普通的 DMA 命令
+    u8 command = type == REQ_READ ? AHCI_CMD_READ_DMA_EXT : AHCI_CMD_WRITE_DMA_EXT;
+    ahci_build(disk, 0, command, lba, count, prds);
+    return ahci_exec(disk);
+}
+
+// 发送磁盘控制命令，获取对应信息
+static i32 ahci_ioctl(ahci_disk_t *disk, dev_cmd_t cmd, void *args, i32 flags) {
+    switch (cmd) {
+    case DEV_CMD_SECTOR_START:
+        return 0;
+    case DEV_CMD_SECTOR_COUNT:
+        return disk->total_lba;
+    case DEV_CMD_SECTOR_MAX:
+        return DEV_MERGE_MAX;
+    default:
+        panic("Unknown device command %d...", cmd);
+        break;
+    }
+}
+
+// 从磁盘 disk 的第 lba 个扇区开始，读取连续 count 个扇区的数据到缓冲区 buf
+static i32 ahci_read(ahci_disk_t *disk, void *buf, size_t count, size_t lba) {
+    return ahci_rw(disk, buf, count, lba, REQ_READ);
+}
+
+// 将缓冲区 buf 的数据写入磁盘 disk 的第 lba 个扇区开始的连续 count 个扇区
+static i32 ahci_write(ahci_disk_t *disk, void *buf, size_t count, size_t lba) {
+    return ahci_rw(disk, buf, count, lba, REQ_WRITE);
+}
+
+// 开始执行磁盘 disk 的块设备请求 req，选择空闲的命令槽发出命令，由中断驱动完成
+// 使用 NCQ 时多个请求同时位于磁盘的命令队列中，由磁盘决定执行顺序
+static i32 ahci_request(ahci_disk_t *disk, request_t *req) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+
+    u8 slot = 0;
+    while (slot < disk->depth && (disk->issued & (1 << slot))) {
+        slot++;
+    }
+    if (slot == disk->depth) {
+        return EOF;
+    }
+
+    size_t prds = ahci_prepare(disk, slot, req);
+    if (prds == 0) {
+        LOGK("disk %s buffer unavailable for DMA\n", disk->name);
+        return EOF;
+    }
+    ahci_build(disk, slot, ahci_command(disk, req->type), req->idx, req->total, prds);
+
+    disk->slots[slot].request = req;
+    disk->slots[slot].retries = 0;
+    disk->issued |= 1 << slot;
+    ahci_issue(disk, slot);
+    return 0;
+}
+
+// 结束命令槽 slot 的请求，完成请求时设备层可能会发出下一个请求
+static void ahci_slot_complete(ahci_disk_t *disk, u8 slot, i32 ret) {
+    request_t *req = disk->slots[slot].request;
+    disk->slots[slot].request = NULL;
+    disk->issued &= ~(1 << slot);
+    request_complete(req, ret);
+}
+
+// 端口出错后 NCQ 队列中的命令全部中止，重新启动端口，并重试正在执行的请求
+static void ahci_port_recover(ahci_disk_t *disk) {
+    ahci_port_t *port = disk->port;
+    LOGK("disk %s error tfd 0x%x serr 0x%x\n", disk->name, port->tfd, port->serr);
+
+    ahci_port_stop(port);
+    port->serr = port->serr;
+    port->is = port->is;
+
+    // 设备仍然忙碌时，通过通信复位恢复设备
+    if (port->tfd & (AHCI_TFD_BSY | AHCI_TFD_DRQ)) {
+        port->sctl = (port->sctl & ~AHCI_SSTS_DET) | AHCI_SCTL_DET_INIT;
+        ahci_spin(&port->ssts, AHCI_SSTS_DET, 0);
+        port->sctl &= ~AHCI_SSTS_DET;
+        ahci_spin(&port->ssts, AHCI_SSTS_DET, AHCI_DET_PRESENT);
+        port->serr = port->serr;
+    }
+    ahci_port_start(port);
+
+    u32 issued = disk->issued;
+    for (u8 slot = 0; slot < disk->depth; slot++) {
+        if (!(issued & (1 << slot))) continue;
+
+        ahci_slot_t *ptr = &disk->slots[slot];
+        if (++ptr->retries > AHCI_RETRY_MAX) {
+            LOGK("disk %s request index %d failed\n", disk->name, ptr->request->idx);
+            ahci_slot_complete(disk, slot, EOF);
+            continue;
+        }
+        ahci_issue(disk, slot);
+    }
+}
+
+// 处理端口中断，命令槽对应的命令发出位和 SATA 活动位都被清除时，命令完成
+static void ahci_port_intr(ahci_disk_t *disk) {
+    ahci_port_t *port = disk->port;
+    u32 is = port->is;
+    port->is = is;
+
+    if (is & AHCI_PxIS_ERROR) {
+        ahci_port_recover(disk);
+        return;
+    }
+
+    u32 done = disk->issued & ~(port->sact | port->ci);
+    for (u8 slot = 0; done; slot++) {
+        if (!(done & (1 << slot))) continue;
+        done &= ~(1 << slot);
+        ahci_slot_complete(disk, slot, 0);
+    }
+}
+
+// AHCI 控制器中断处理
+static void ahci_handler(int vector) {
+    send_eoi(vector);
+
+    u32 is = hba->is;
+    for (size_t i = 0; i < disk_count; i++) {
+        ahci_disk_t *disk = &disks[i];
+        if (is & (1 << disk->index)) {
+            ahci_port_intr(disk);
+        }
+    }
+    hba->is = is;
+}
+
+// 从分区 part 的第 lba 个扇区开始读取
+static i32 ahci_partition_read(ahci_partition_t *part, void *buf, size_t count, size_t lba) {
+    return ahci_read(part->disk, buf, count, part->start_lba + lba);
+}
+
+// 从分区 part 的第 lba 个扇区开始写入
+static i32 ahci_partition_write(ahci_partition_t *part, void *buf, size_t count, size_t lba) {
+    return ahci_write(part->disk, buf, count, part->start_lba + lba);
+}
+
+// 发送分区控制命令，获取对应信息
+static i32 ahci_partition_ioctl(ahci_partition_t *part, dev_cmd_t cmd, void *args, i32 flags) {
+    switch (cmd) {
+    case DEV_CMD_SECTOR_START:
+        return part->start_lba;
+    case DEV_CMD_SECTOR_COUNT:
+        return part->count;
+    case DEV_CMD_SECTOR_MAX:
+        return DEV_MERGE_MAX;
+    default:
+        panic("Unknown device command %d...", cmd);
+        break;
+    }
+}
+
+// 识别磁盘，获取扇区数量和 NCQ 队列深度
+static i32 ahci_identify(ahci_disk_t *disk, u16 *buf) {
+    LOGK("identifing disk %s...\n", disk->name);
+
+    request_t req;
+    req.buf = buf;
+    req.count = 1;
+    req.next = NULL;
+    ahci_build(disk, 0, AHCI_CMD_IDENTIFY, 0, 0, ahci_prepare(disk, 0, &req));
+    if (ahci_exec(disk) < 0) {
+        LOGK("disk %s identify failed\n", disk->name);
+        return EOF;
+    }
+
+    if (buf[AHCI_ID_COMMAND_SET] & (1 << 10)) {
+        disk->total_lba = *(u32 *)&buf[AHCI_ID_TOTAL_LBA48];
+    } else {
+        disk->total_lba = *(u32 *)&buf[AHCI_ID_TOTAL_LBA];
+    }
+
+    // 控制器和磁盘都支持 NCQ 时，队列深度取命令槽数量和磁盘队列深度的较小值
+    u32 slots = MIN(AHCI_CAP_NCS(hba->cap), AHCI_SLOT_NR);
+    disk->ncq = (hba->cap & AHCI_CAP_SNCQ) && (buf[AHCI_ID_SATA_CAP] & (1 << 8));
+    disk->depth = disk->ncq ? MIN(slots, (buf[AHCI_ID_QUEUE_DEPTH] & 0x1f) + 1u) : 1;
+
+    LOGK("disk %s total lba %d ncq %d depth %d\n", disk->name, disk->total_lba, disk->ncq, disk->depth);
+    return 0;
+}
+
+// 磁盘分区
+static void ahci_partition(ahci_disk_t *disk, u16 *buf) {
+    // 读取主引导扇区
+    if (ahci_read(disk, buf, 1, 0) < 0) {
+        return;
+    }
+    mbr_t *mbr = (mbr_t *)buf;
+
+    // 扫描分区表信息，目前只支持主分区
+    for (size_t i = 0; i < ATA_PARTITION_NR; i++) {
+        partition_entry_t *entry = &mbr->partition_table[i];
+        ahci_partition_t *part = &disk->parts[i];
+
+        // 分区不存在
+        if (entry->count == 0 || entry->system == PARTITION_FS_EXTENDED) {
+            part->count = 0;
+            continue;
+        }
+
+        sprintf(part->name, "%s%d", disk->name, i + 1);
+        LOGK("partition %s start %d count %d system 0x%x\n",
+             part->name, entry->start_lba, entry->count, entry->system);
+
+        // 配置系统分区信息
+        part->disk = disk;
+        part->system = entry->system;
+        part->start_lba = entry->start_lba;
+        part->count = entry->count;
+    }
+}
+
+// 初始化端口 index 上的磁盘，设置命令列表和 FIS 接收区，成功返回 0
+static i32 ahci_port_init(ahci_disk_t *disk, u8 index, u16 *buf) {
+    ahci_port_t *port = &hba->ports[index];
+    sprintf(disk->name, "sd%c", 'a' + disk_count);
+    disk->port = port;
+    disk->index = index;
+    disk->issued = 0;
+
+    // 命令列表 (1K) 和 FIS 接收区 (256B) 位于同一页中，每个命令槽使用一个命令表
+    ahci_port_stop(port);
+    u32 page = kalloc_page(1);
+    memset((void *)page, 0, PAGE_SIZE);
+    disk->cmds = (ahci_cmd_header_t *)page;
+    disk->fis = (u8 *)(page + 1024);
+    disk->tables = (ahci_cmd_table_t *)kalloc_page(AHCI_TABLE_PAGES);
+    memset(disk->tables, 0, AHCI_TABLE_PAGES * PAGE_SIZE);
+
+    for (size_t slot = 0; slot < AHCI_SLOT_NR; slot++) {
+        disk->cmds[slot].ctba = (u32)&disk->tables[slot];
+        disk->cmds[slot].ctbau = 0;
+        disk->slots[slot].request = NULL;
+    }
+
+    port->clb = (u32)disk->cmds;
+    port->clbu = 0;
+    port->fb = (u32)disk->fis;
+    port->fbu = 0;
+    port->serr = port->serr;
+    port->is = port->is;
+    ahci_port_start(port);
+
+    if (ahci_identify(disk, buf) < 0) {
+        ahci_port_stop(port);
+        kfree_page((u32)disk->tables, AHCI_TABLE_PAGES);
+        kfree_page(page, 1);
+        return EOF;
+    }
+    memset((void *)buf, 0, PAGE_SIZE);
+    ahci_partition(disk, buf);
+
+    // 打开端口中断
+    port->ie = AHCI_PxIS_DHRS | AHCI_PxIS_PSS | AHCI_PxIS_SDBS | AHCI_PxIS_ERROR;
+    return 0;
+}
+
+// 安装块设备
+static void ahci_device_install() {
+    for (size_t i = 0; i < disk_count; i++) {
+        ahci_disk_t *disk = &disks[i];
+
+        // 安装磁盘设备，使用 NCQ 时允许同时执行多个请求
+        devid_t dev_id = dev_install(DEV_BLOCK, DEV_SATA_DISK, disk, disk->name, -1,
+                                     ahci_ioctl, ahci_read, ahci_write);
+        dev_install_request(dev_id, ahci_request);
+        dev_ioctl(dev_id, DEV_CMD_QUEUE_DEPTH, (void *)(u32)disk->depth, 0);
+
+        for (size_t pidx = 0; pidx < ATA_PARTITION_NR; pidx++) {
+            ahci_partition_t *part = &disk->parts[pidx];
+
+            // 分区不存在
+            if (part->count == 0) continue;
+            // 安装分区设备，分区的请求会转换为对磁盘的请求
+            dev_install(DEV_BLOCK, DEV_SATA_PART, part, part->name, dev_id,
+                        ahci_partition_ioctl, ahci_partition_read,
+                        ahci_partition_write);
+        }
+    }
+}
+
+// 查找 AHCI 控制器，初始化已连接磁盘的端口
+void ahci_init() {
+    pci_device_t *device = NULL;
+    for (size_t i = 0; (device = pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_SATA, i)); i++) {
+        if ((device->classcode & 0xff) == PCI_PROGIF_AHCI) break;
+    }
+    if (device == NULL) {
+        LOGK("AHCI controller not found\n");
+        return;
+    }
+    LOGK("ahci init...\n");
+
+    // ABAR 位于高端物理地址，需要映射到内核虚拟内存
+    u32 abar = pci_inl(device, PCI_CONF_BASE_ADDR0 + AHCI_ABAR * 4) & ~0xf;
+    pci_enable_busmaster(device);
+    hba = (ahci_hba_t *)kmap_mmio(abar, sizeof(ahci_hba_t));
+
+    // 启用 AHCI 模式，并清除所有中断
+    hba->ghc |= AHCI_GHC_AE;
+    hba->is = hba->is;
+
+    u16 *buf = (u16 *)kalloc_page(1);
+    disk_count = 0;
+    for (u8 index = 0; index < AHCI_PORT_NR && disk_count < AHCI_DISK_NR; index++) {
+        if (!(hba->pi & (1 << index))) continue;
+
+        // 只使用已连接的 SATA 磁盘
+        ahci_port_t *port = &hba->ports[index];
+        if ((port->ssts & AHCI_SSTS_DET) != AHCI_DET_PRESENT || port->sig != AHCI_SIG_ATA) {
+            continue;
+        }
+        memset((void *)buf, 0, PAGE_SIZE);
+        if (ahci_port_init(&disks[disk_count], index, buf) == 0) {
+            disk_count++;
+        }
+    }
+    kfree_page((u32)buf, 1);
+
+    ahci_device_install();
+
+    // 注册控制器中断，并取消对应的屏蔽字
+    hba->is = hba->is;
+    hba->ghc |= AHCI_GHC_IE;
+    set_interrupt_handler(device->irq, ahci_handler);
+    set_interrupt_mask(device->irq, true);
+    if (device->irq >= 8) {
+        set_interrupt_mask(IRQ_CASCADE, true);
+    }
+}
@@ -7,6 +7,13 @@
 #include <xos/assert.h>
 #include <xos/debug.h>
 #include <xos/task.h>
+#include <xos/iosched.h>
+#include <xos/pci.h>
+#include <xos/stdlib.h>
+#include <xos/syscall.h>
+
+extern u32 volatile jiffies;
+extern const u32 jiffy;
 
 // ATA 总线寄存器基址
 #define ATA_IOBASE_PRIMARY      0x1F0
@@ -55,13 +62,58 @@
 // ATA 命令
 #define ATA_CMD_READ        0x20    // 读命令
 #define ATA_CMD_WRITE       0x30    // 写命令
+#define ATA_CMD_READ_MULTI  0xC4    // 多扇区读命令
+#define ATA_CMD_WRITE_MULTI 0xC5    // 多扇区写命令
+#define ATA_CMD_SET_MULTI   0xC6    // 设置多扇区模式
+#define ATA_CMD_READ_DMA    0xC8    // DMA 读命令
+#define ATA_CMD_WRITE_DMA   0xCA    // DMA 写命令
 #define ATA_CMD_IDENTIFY    0xEC    // 识别命令
 
+// 超时与重试
+#define ATA_TIMEOUT         5000    // 命令超时时间 (ms)
+#define ATA_RETRY_MAX       3       // 请求出错或超时后的最大重试次数
+#define ATA_WATCHDOG        100     // 超时检测线程的检测周期 (ms)
+#define ATA_SPIN_MAX        100000  // 短暂忙等待读取备用状态寄存器的最大次数 (每次约 1us)
+#define ATA_DRQ_SPIN        64      // PIO 写命令后检测驱动器请求数据的最大次数 (每次约 400ns)
+
+// 总线等待驱动器就绪的步骤，由中断或下一个时钟中断检测状态后继续，不忙等待驱动器
+#define ATA_PENDING_NONE    0       // 没有等待的步骤
+#define ATA_PENDING_ISSUE   1       // 等待驱动器空闲后发送命令
+#define ATA_PENDING_DRQ     2       // PIO 写命令等待驱动器请求第一个块的数据
+#define ATA_PENDING_MULTI   3       // 复位后等待驱动器空闲后设置多扇区模式
+#define ATA_PENDING_SET     4       // 复位后等待设置多扇区模式的命令完成
+
 // ATA 总线设备控制寄存器命令
 #define ATA_CTRL_HD15       0x00    // Use 4 bits for head (not used, was 0x08)
 #define ATA_CTRL_SRST       0x04    // Soft reset
 #define ATA_CTRL_NIEN       0x02    // Disable interrupts
 
+// 总线主控 DMA 寄存器偏移
+#define ATA_BM_COMMAND      0       // 命令寄存器
+#define ATA_BM_STATUS       2       // 状态寄存器
+#define ATA_BM_PRDT         4       // 物理区域描述符表地址寄存器
+
+// 总线主控 DMA 命令寄存器
+#define ATA_BM_CMD_START    0x01    // 开始传输
+#define ATA_BM_CMD_READ     0x08    // 传输方向为写入内存 (读磁盘)
+
+// 总线主控 DMA 状态寄存器
+#define ATA_BM_SR_ACTIVE    0x01    // 传输进行中
+#define ATA_BM_SR_ERR       0x02    // 传输错误
+#define ATA_BM_SR_INT       0x04    // 磁盘产生中断
+
+#define ATA_PRD_NR          (PAGE_SIZE / sizeof(ata_prd_t)) // 物理区域描述符表的容量
+#define ATA_PRD_EOT         0x8000  // 最后一个物理区域描述符
+#define ATA_PRD_BOUNDARY    0x10000 // 物理区域不能跨越 64K 边界
+
+// IDE 控制器的 PCI 类代码
+#define PCI_CLASS_STORAGE   0x01    // 大容量存储控制器
+#define PCI_SUBCLASS_IDE    0x01    // IDE 控制器
+#define ATA_BM_BAR          4       // 总线主控寄存器所在的基址寄存器
+
+// 单条读写命令的最大扇区数 (扇区数量寄存器为 8 位)
+#define ATA_SECTOR_MAX      255
+
 #define ATA_MASTER_SELECTOR 0b11100000
 #define ATA_SLAVE_SELECTOR  0b11110000
 
@@ -127,9 +179,9 @@ static u32 ata_error(ata_bus_t *bus) {
 }
 
 // 忙等待 (mask 用于指定等待的事件，为 ATA_SR_NULL (0) 则直到表示繁忙结束)
+// 只用于初始化时 (识别磁盘和外中断开启前的轮询)，超过 ATA_SPIN_MAX 次检测后视为超时，与出错一样返回 ATA_SR_ERR
 static i32 ata_busy_wait(ata_bus_t *bus, u8 mask) {
-    // TODO: reset when controller detects error and timeout
-    while (true) {
+    for (size_t i = 0; i < ATA_SPIN_MAX; i++) {
         // 从备用状态寄存器读取状态
         u8 state = inb(bus->ctlbase + ATA_CTL_ALT_STATUS);
         // 如果有错误，则进行错误检测
@@ -146,6 +198,25 @@ static i32 ata_busy_wait(ata_bus_t *bus, u8 mask) {
             return 0;
         }
     }
+    LOGK("bus %s wait status 0x%x timeout\n", bus->name, mask);
+    return ATA_SR_ERR;
+}
+
+// 设置总线当前命令的超时时刻
+static void ata_set_timeout(ata_bus_t *bus) {
+    bus->expires = jiffies + ATA_TIMEOUT / jiffy;
+}
+
+// 总线当前命令是否已超时
+static bool ata_expired(ata_bus_t *bus) {
+    return (i32)(jiffies - bus->expires) >= 0;
+}
+
+// 读取 4 次备用状态寄存器，等待约 400ns 使得状态寄存器有效
+static void ata_delay(ata_bus_t *bus) {
+    for (size_t i = 0; i < 4; i++) {
+        inb(bus->ctlbase + ATA_CTL_ALT_STATUS);
+    }
 }
 
 // 选择磁盘
@@ -174,89 +245,498 @@ static void ata_select_sector(ata_disk_t *disk, size_t lba, u8 count) {
 
 // 读取一个扇区的内容到缓冲区
 static void ata_pio_read_sector(ata_disk_t *disk, u16 *buf) {
-    for (size_t i = 0; i < (SECTOR_SIZE / sizeof(u16)); i++) {
-        buf[i] = inw(disk->bus->iobase + ATA_IO_DATA);
-    }
+    insw(disk->bus->iobase + ATA_IO_DATA, buf, SECTOR_SIZE / sizeof(u16));
 }
 
 // 将缓冲区的内容写入一个扇区
 static void ata_pio_write_sector(ata_disk_t *disk, u16 *buf) {
-    for (size_t i = 0; i < (SECTOR_SIZE / sizeof(u16)); i++) {
-        outw(disk->bus->iobase + ATA_IO_DATA, buf[i]);
-    }
+    outsw(disk->bus->iobase + ATA_IO_DATA, buf, SECTOR_SIZE / sizeof(u16));
 }
 
+// 同步读写同样经过磁盘的请求队列，由中断驱动完成传输，不忙等待驱动器
 i32 ata_pio_read(ata_disk_t *disk, void *buf, u8 count, size_t lba) {
     assert(count > 0);          // 保证读取扇区数不为 0
     ASSERT_IRQ_DISABLE();       // 保证为外中断禁止
+    return dev_request(disk->dev_id, buf, count, lba, 0, REQ_READ);
+}
 
-    ata_bus_t *bus = disk->bus; // 对应的 ATA 总线
-    mutexlock_acquire(&bus->lock);  // 获取总线的锁
-    
-    // 选择磁盘
-    ata_select_disk(disk);      
-
-    // 等待就绪
-    ata_busy_wait(bus, ATA_SR_DRDY);
+i32 ata_pio_write(ata_disk_t *disk, void *buf, u8 count, size_t lba) {
+    assert(count > 0);          // 保证写入扇区数不为 0
+    ASSERT_IRQ_DISABLE();       // 保证为外中断禁止
+    return dev_request(disk->dev_id, buf, count, lba, 0, REQ_WRITE);
+}
 
-    // 选择扇区级对应扇区数量
-    ata_select_sector(disk, lba, count);
+// 当前块的扇区数量，即一次中断 (一个 DRQ 块) 传输的扇区数
+static size_t ata_pio_block(ata_bus_t *bus, ata_disk_t *disk, request_t *req) {
+    size_t count = req->total - bus->sector;
+    return disk->multiple < count ? disk->multiple : count;
+}
 
-    // 发送读命令
-    outb(bus->iobase + ATA_IO_COMMAND, ATA_CMD_READ);
+// 从数据寄存器读取当前块的所有扇区
+static void ata_pio_read_block(ata_bus_t *bus, ata_disk_t *disk, request_t *req) {
+    size_t count = ata_pio_block(bus, disk, req);
+    for (size_t i = 0; i < count; i++) {
+        ata_pio_read_sector(disk, request_buffer(req, bus->sector + i));
+    }
+    bus->sector += count;
+}
 
-    // 持续读取磁盘对应的扇区内容直至读取完成
+// 向数据寄存器写入当前块的所有扇区，块写入完成产生中断后才推进 bus->sector
+static void ata_pio_write_block(ata_bus_t *bus, ata_disk_t *disk, request_t *req) {
+    size_t count = ata_pio_block(bus, disk, req);
     for (size_t i = 0; i < count; i++) {
-        task_t *task = current_task();
-        // 如果是初始化时调用硬盘读写功能，则使用同步方式
-        if (task->state == TASK_RUNNING) {
-            // 阻塞自己直到中断带来表示就绪
-            bus->waiter = task;
-            task_block(task, NULL, TASK_BLOCKED);
+        ata_pio_write_sector(disk, request_buffer(req, bus->sector + i));
+    }
+}
+
+// 总线上正在传输的请求结束，ret 为执行结果，之后总线开始传输下一个请求
+static void ata_bus_start(ata_bus_t *bus);
+static void ata_bus_retry(ata_bus_t *bus);
+static void ata_bus_resume(ata_bus_t *bus);
+static void ata_bus_finish(ata_bus_t *bus, i32 ret) {
+    request_t *req = bus->request;
+    ata_disk_t *disk = bus->active;
+    assert(disk->request == req);
+
+    bus->request = NULL;
+    disk->request = NULL;
+
+    // 完成请求时，设备层可能会为该磁盘分配下一个请求
+    request_complete(req, ret);
+    ata_bus_start(bus);
+}
+
+// 根据合并后的请求 req 的各个缓冲区构造物理区域描述符表，失败时返回 false
+static bool ata_dma_prepare(ata_bus_t *bus, request_t *req) {
+    ata_prd_t *prd = bus->prdt;
+    size_t count = 0;
+
+    for (request_t *ptr = req; ptr; ptr = ptr->next) {
+        u32 addr = (u32)ptr->buf;
+        u32 len = ptr->count * SECTOR_SIZE;
+
+        // DMA 使用物理地址，缓冲区必须位于恒等映射的内核内存，并且按字对齐
+        if (addr + len > KERNEL_MEMORY_SIZE || (addr & 1)) {
+            return false;
+        }
+
+        while (len > 0) {
+            if (count == ATA_PRD_NR) {
+                return false;
+            }
+            u32 size = MIN(len, ATA_PRD_BOUNDARY - (addr & (ATA_PRD_BOUNDARY - 1)));
+            prd[count].addr = addr;
+            prd[count].len = size & 0xffff;
+            prd[count].flags = 0;
+            count++;
+            addr += size;
+            len -= size;
         }
-        ata_busy_wait(bus, ATA_SR_DRQ); // 等待 PIO 数据准备完成
-        
-        u32 offset = ((u32)buf + i * SECTOR_SIZE);
-        ata_pio_read_sector(disk, (u16 *)offset);
     }
 
-    mutexlock_release(&bus->lock);
-    return 0;
+    prd[count - 1].flags = ATA_PRD_EOT;
+    return true;
 }
 
-i32 ata_pio_write(ata_disk_t *disk, void *buf, u8 count, size_t lba) {
-    assert(count > 0);          // 保证读取扇区数不为 0
-    ASSERT_IRQ_DISABLE();       // 保证为外中断禁止
+// 使用 DMA 开始传输磁盘 disk 的请求 req，总线不支持 DMA 时返回 false
+static bool ata_dma_start(ata_bus_t *bus, ata_disk_t *disk, request_t *req) {
+    if (!bus->bmbase || !disk->dma || !ata_dma_prepare(bus, req)) {
+        return false;
+    }
+    bus->dma = true;
+
+    // 设置物理区域描述符表和传输方向，并清除中断和错误状态
+    outl(bus->bmbase + ATA_BM_PRDT, (u32)bus->prdt);
+    outb(bus->bmbase + ATA_BM_COMMAND, req->type == REQ_READ ? ATA_BM_CMD_READ : 0);
+    outb(bus->bmbase + ATA_BM_STATUS, inb(bus->bmbase + ATA_BM_STATUS) | ATA_BM_SR_INT | ATA_BM_SR_ERR);
+
+    // 选择扇区级对应扇区数量，发送 DMA 读/写命令，之后启动总线主控开始传输
+    ata_select_sector(disk, req->idx, req->total);
+    outb(bus->iobase + ATA_IO_COMMAND, req->type == REQ_READ ? ATA_CMD_READ_DMA : ATA_CMD_WRITE_DMA);
+    outb(bus->bmbase + ATA_BM_COMMAND, inb(bus->bmbase + ATA_BM_COMMAND) | ATA_BM_CMD_START);
+    return true;
+}
 
-    ata_bus_t *bus = disk->bus; // 对应的 ATA 总线
-    mutexlock_acquire(&bus->lock);  // 获取总线的锁
-    
-    // 选择磁盘
-    ata_select_disk(disk);      
+// 停止总线主控，并清除中断和错误状态，返回停止前的总线主控状态
+static u8 ata_dma_stop(ata_bus_t *bus) {
+    u8 bmstate = inb(bus->bmbase + ATA_BM_STATUS);
+    outb(bus->bmbase + ATA_BM_COMMAND, inb(bus->bmbase + ATA_BM_COMMAND) & ~ATA_BM_CMD_START);
+    outb(bus->bmbase + ATA_BM_STATUS, bmstate | ATA_BM_SR_INT | ATA_BM_SR_ERR);
+    return bmstate;
+}
 
-    // 等待就绪
-    ata_busy_wait(bus, ATA_SR_DRDY);
+// 软件方法重置总线上的驱动器，不等待驱动器复位完成
+static void ata_reset_derive(ata_bus_t *bus) {
+    outb(bus->ctlbase + ATA_CTL_DEV_CONTROL, ATA_CTRL_SRST);
+    // 复位信号至少保持 5us
+    for (size_t i = 0; i < 16; i++) {
+        ata_delay(bus);
+    }
+    outb(bus->ctlbase + ATA_CTL_DEV_CONTROL, 0);
+}
 
-    // 选择扇区级对应扇区数量
-    ata_select_sector(disk, lba, count);
+// 识别磁盘时设置磁盘的多扇区模式，count 为每个 DRQ 块的扇区数，设置失败则每个块只有一个扇区
+// 只在初始化时调用，复位后由 ata_bus_setup 在中断驱动下重新设置
+static void ata_set_multiple(ata_disk_t *disk, u8 count) {
+    ata_bus_t *bus = disk->bus;
+    disk->multiple = 1;
 
-    // 发送读命令
-    outb(bus->iobase + ATA_IO_COMMAND, ATA_CMD_WRITE);
+    // 磁盘不支持多扇区模式
+    if (count <= 1) {
+        return;
+    }
 
-    // 持续读取磁盘对应的扇区内容直至读取完成
-    for (size_t i = 0; i < count; i++) {
-        u32 offset = ((u32)buf + i * SECTOR_SIZE);
-        ata_pio_write_sector(disk, (u16 *)offset);
+    // 命令完成后不产生中断，以免被当作总线上请求的中断
+    outb(bus->ctlbase + ATA_CTL_DEV_CONTROL, ATA_CTRL_NIEN);
+    outb(bus->iobase + ATA_IO_DEVICE, disk->selector);
+    if (ata_busy_wait(bus, ATA_SR_DRDY) == ATA_SR_ERR) {
+        goto rollback;
+    }
+    outb(bus->iobase + ATA_IO_SECNR, count);
+    outb(bus->iobase + ATA_IO_COMMAND, ATA_CMD_SET_MULTI);
+    ata_delay(bus);
+
+    if (ata_busy_wait(bus, ATA_SR_NULL) == ATA_SR_ERR) {
+        LOGK("disk %s set multiple mode failed...\n", disk->name);
+        goto rollback;
+    }
+    disk->multiple = count;
+
+rollback:
+    outb(bus->ctlbase + ATA_CTL_DEV_CONTROL, 0);
+}
+
+// 总线上的请求超时或者驱动器状态异常，软件复位驱动器，复位完成后由 ata_reset_check 重试请求
+static void ata_bus_timeout(ata_bus_t *bus) {
+    LOGK("bus %s reset, status 0x%x\n", bus->name, inb(bus->ctlbase + ATA_CTL_ALT_STATUS));
+    if (bus->dma) {
+        ata_dma_stop(bus);
+    }
+    ata_reset_derive(bus);
+    bus->resetting = true;
+    bus->pending = ATA_PENDING_NONE;
+    ata_set_timeout(bus);
+}
+
+// 向磁盘发送总线上请求的读写命令，驱动器已经选择并且就绪
+static void ata_bus_send(ata_bus_t *bus) {
+    request_t *req = bus->request;
+    ata_disk_t *disk = bus->active;
+
+    // 优先使用 DMA 传输，CPU 无需参与数据的搬运
+    if (ata_dma_start(bus, disk, req)) {
+        return;
+    }
+
+    // 否则使用 PIO 传输，选择扇区级对应扇区数量，并发送读/写命令
+    // 磁盘启用了多扇区模式时，每次中断传输一个块 (multiple 个扇区)
+    ata_select_sector(disk, req->idx, req->total);
+    bool multi = disk->multiple > 1;
+    if (req->type == REQ_READ) {
+        outb(bus->iobase + ATA_IO_COMMAND, multi ? ATA_CMD_READ_MULTI : ATA_CMD_READ);
+        return;
+    }
+    outb(bus->iobase + ATA_IO_COMMAND, multi ? ATA_CMD_WRITE_MULTI : ATA_CMD_WRITE);
+
+    // 写命令需要先写入第一个块，驱动器请求数据时不产生中断
+    // 驱动器通常在几微秒内请求数据，短暂检测有限次数，仍未请求时由下一个时钟中断检测
+    bus->pending = ATA_PENDING_DRQ;
+    for (size_t i = 0; i < ATA_DRQ_SPIN && bus->pending == ATA_PENDING_DRQ; i++) {
+        ata_delay(bus);
+        ata_bus_resume(bus);
+    }
+}
+
+static void ata_bus_setup(ata_bus_t *bus);
+
+// 复位后设置磁盘多扇区模式的步骤结束，ok 为 false 时磁盘改用单扇区模式，之后设置下一个磁盘
+static void ata_setup_done(ata_bus_t *bus, bool ok) {
+    ata_disk_t *disk = &bus->disks[bus->setup];
+    if (!ok) {
+        LOGK("disk %s set multiple mode failed...\n", disk->name);
+        disk->multiple = 1;
+    }
+    bus->pending = ATA_PENDING_NONE;
+    bus->setup++;
+    ata_bus_setup(bus);
+}
+
+// 检测一次驱动器状态，驱动器就绪时继续总线上请求等待的步骤，超时则复位驱动器
+static void ata_bus_resume(ata_bus_t *bus) {
+    u8 state = inb(bus->ctlbase + ATA_CTL_ALT_STATUS);
+
+    if (!(state & ATA_SR_BSY)) {
+        if (bus->pending == ATA_PENDING_ISSUE && (state & ATA_SR_DRDY)) {
+            bus->pending = ATA_PENDING_NONE;
+            ata_bus_send(bus);
+            return;
+        }
+        if (bus->pending == ATA_PENDING_DRQ && (state & ATA_SR_ERR)) {
+            ata_error(bus);
+            bus->pending = ATA_PENDING_NONE;
+            ata_bus_retry(bus);
+            return;
+        }
+        if (bus->pending == ATA_PENDING_DRQ && (state & ATA_SR_DRQ)) {
+            bus->pending = ATA_PENDING_NONE;
+            ata_pio_write_block(bus, bus->active, bus->request);
+            return;
+        }
+        if (bus->pending == ATA_PENDING_MULTI && (state & ATA_SR_DRDY)) {
+            bus->pending = ATA_PENDING_SET;
+            outb(bus->iobase + ATA_IO_SECNR, bus->disks[bus->setup].multiple);
+            outb(bus->iobase + ATA_IO_COMMAND, ATA_CMD_SET_MULTI);
+            ata_delay(bus);
+            return;
+        }
+        if (bus->pending == ATA_PENDING_SET) {
+            if (state & ATA_SR_ERR) {
+                ata_error(bus);
+            }
+            ata_setup_done(bus, !(state & ATA_SR_ERR));
+            return;
+        }
+    }
+
+    if (!ata_expired(bus)) {
+        return;
+    }
+    // 恢复磁盘设置超时不再复位，磁盘改用单扇区模式
+    if (bus->pending == ATA_PENDING_MULTI || bus->pending == ATA_PENDING_SET) {
+        ata_setup_done(bus, false);
+        return;
+    }
+    ata_bus_timeout(bus);
+}
+
+// 开始传输总线上的请求，从请求的第一个扇区开始
+// 选择磁盘后只检测一次驱动器状态，驱动器繁忙时由中断或超时检测线程稍后发送命令
+static void ata_bus_issue(ata_bus_t *bus) {
+    bus->sector = 0;
+    bus->dma = false;
+    ata_set_timeout(bus);
+
+    ata_select_disk(bus->active);
+    ata_delay(bus);
+    bus->pending = ATA_PENDING_ISSUE;
+    ata_bus_resume(bus);
+}
+
+// 重试总线上出错的请求，超过重试次数则以错误结束请求
+static void ata_bus_retry(ata_bus_t *bus) {
+    if (bus->retries++ < ATA_RETRY_MAX) {
+        LOGK("bus %s retry request %d\n", bus->name, bus->retries);
+        ata_bus_issue(bus);
+        return;
+    }
+    ata_bus_finish(bus, EOF);
+}
+
+// 复位后从磁盘 bus->setup 开始依次恢复多扇区模式，每个磁盘的设置命令由中断驱动完成
+// 全部磁盘设置完成后结束复位，重试或者开始总线上的请求
+static void ata_bus_setup(ata_bus_t *bus) {
+    for (; bus->setup < ATA_DISK_NR; bus->setup++) {
+        ata_disk_t *disk = &bus->disks[bus->setup];
+        if (disk->total_lba == 0 || disk->multiple <= 1) {
+            continue;
+        }
+
+        // 只选择驱动器，不改变总线上请求所在的磁盘 bus->active
+        ata_set_timeout(bus);
+        outb(bus->iobase + ATA_IO_DEVICE, disk->selector);
+        ata_delay(bus);
+        bus->pending = ATA_PENDING_MULTI;
+        ata_bus_resume(bus);
+        return;
+    }
+
+    bus->resetting = false;
+    if (bus->request) {
+        ata_bus_retry(bus);
+    } else {
+        ata_bus_start(bus);
+    }
+}
+
+// 检测总线的软件复位是否完成，完成后恢复磁盘设置并重试总线上的请求
+static void ata_reset_check(ata_bus_t *bus) {
+    // 正在恢复磁盘设置，检测驱动器状态后继续
+    if (bus->pending) {
+        ata_bus_resume(bus);
+        return;
+    }
+
+    if (inb(bus->ctlbase + ATA_CTL_ALT_STATUS) & ATA_SR_BSY) {
+        if (!ata_expired(bus)) {
+            return;
+        }
+        // 驱动器复位超时，放弃正在传输的请求
+        LOGK("bus %s reset timeout\n", bus->name);
+        bus->resetting = false;
+        if (bus->request) {
+            ata_bus_finish(bus, EOF);
+        }
+        return;
+    }
+
+    // 复位使得驱动器恢复默认设置，重新设置多扇区模式
+    bus->setup = 0;
+    ata_bus_setup(bus);
+}
+
+// DMA 传输完成后产生中断，state 为状态寄存器的值
+static void ata_dma_intr(ata_bus_t *bus, u8 state) {
+    u8 bmstate = ata_dma_stop(bus);
+
+    if ((state & ATA_SR_ERR) || (bmstate & ATA_BM_SR_ERR)) {
+        LOGK("bus %s DMA error state 0x%x bus master state 0x%x\n", bus->name, state, bmstate);
+        if (state & ATA_SR_ERR) {
+            ata_error(bus);
+        }
+        ata_bus_retry(bus);
+        return;
+    }
+    ata_bus_finish(bus, 0);
+}
+
+// 总线空闲时，选择一个有待处理请求的磁盘，发送读写命令开始传输
+static void ata_bus_start(ata_bus_t *bus) {
+    if (bus->request || bus->resetting) {
+        return;
+    }
+
+    // 从上一次传输的磁盘的下一个磁盘开始选择，使得总线上的磁盘轮流传输
+    size_t last = bus->active ? bus->active - bus->disks : 0;
+    ata_disk_t *disk = NULL;
+    for (size_t i = 1; i <= ATA_DISK_NR; i++) {
+        ata_disk_t *ptr = &bus->disks[(last + i) % ATA_DISK_NR];
+        if (ptr->request) {
+            disk = ptr;
+            break;
+        }
+    }
+    if (disk == NULL) {
+        return;
+    }
+
+    bus->request = disk->request;
+    bus->active = disk;
+    bus->retries = 0;
+    ata_bus_issue(bus);
+}
+
+// 总线 bus 上正在传输的请求产生中断，state 为状态寄存器的值
+// 中断到来时驱动器已经准备好数据或者完成了写入，处理过程中不会忙等待驱动器
+static void ata_bus_intr(ata_bus_t *bus, u8 state) {
+    request_t *req = bus->request;
+    ata_disk_t *disk = bus->active;
+
+    // 请求在等待驱动器就绪，检测驱动器状态后继续
+    if (bus->pending) {
+        ata_bus_resume(bus);
+        return;
+    }
+
+    // 驱动器仍然繁忙，不是该请求的中断
+    if (state & ATA_SR_BSY) {
+        return;
+    }
+
+    if (bus->dma) {
+        ata_dma_intr(bus, state);
+        return;
+    }
+
+    if (state & ATA_SR_ERR) {
+        ata_error(bus);
+        ata_bus_retry(bus);
+        return;
+    }
 
-        task_t *task = current_task();
-        if (task->state == TASK_RUNNING) {
-            bus->waiter = task;
-            task_block(task, NULL, TASK_BLOCKED);
+    if (req->type == REQ_WRITE) {
+        // 写命令每个块写入完成后产生一次中断
+        bus->sector += ata_pio_block(bus, disk, req);
+        if (bus->sector == req->total) {
+            ata_bus_finish(bus, 0);
+            return;
         }
-        ata_busy_wait(bus, ATA_SR_NULL); // 等待写入数据完成
     }
 
-    mutexlock_release(&bus->lock);
+    // 读命令每个块的数据准备完成后产生一次中断，写命令则请求写入下一个块
+    if (!(state & ATA_SR_DRQ)) {
+        ata_bus_timeout(bus);
+        return;
+    }
+    ata_set_timeout(bus);
+
+    if (req->type == REQ_READ) {
+        ata_pio_read_block(bus, disk, req);
+        if (bus->sector == req->total) {
+            ata_bus_finish(bus, 0);
+        }
+    } else {
+        ata_pio_write_block(bus, disk, req);
+    }
+}
+
+// 检测总线上的命令是否超时，由超时检测线程周期调用
+static void ata_bus_watchdog(ata_bus_t *bus) {
+    if (bus->resetting) {
+        ata_reset_check(bus);
+        return;
+    }
+    if (bus->pending) {
+        ata_bus_resume(bus);
+        return;
+    }
+    if (!ata_expired(bus)) {
+        return;
+    }
+    if (bus->request) {
+        LOGK("bus %s request timeout\n", bus->name);
+        ata_bus_timeout(bus);
+    }
+}
+
+// 轮询状态寄存器完成总线上的所有请求，用于外中断尚未开启时 (例如初始化时挂载根文件系统)
+// 此时 jiffies 不会增加，驱动器繁忙超过忙等待的上限即视为超时
+static void ata_bus_poll(ata_bus_t *bus) {
+    while (bus->request) {
+        ata_delay(bus);
+        // 请求等待驱动器就绪时，驱动器超过忙等待上限仍未就绪同样视为超时
+        u8 mask = bus->pending == ATA_PENDING_ISSUE || bus->pending == ATA_PENDING_MULTI ? ATA_SR_DRDY :
+                  bus->pending == ATA_PENDING_DRQ ? ATA_SR_DRQ : ATA_SR_NULL;
+        if (ata_busy_wait(bus, mask) == ATA_SR_ERR &&
+            (bus->pending || (inb(bus->ctlbase + ATA_CTL_ALT_STATUS) & ATA_SR_BSY))
+        ) {
+            bus->expires = jiffies;
+        }
+
+        if (bus->resetting) {
+            ata_reset_check(bus);
+        } else if (bus->pending) {
+            ata_bus_resume(bus);
+        } else if (ata_expired(bus)) {
+            ata_bus_timeout(bus);
+        } else {
+            ata_bus_intr(bus, inb(bus->iobase + ATA_IO_STATUS));
+        }
+    }
+}
+
+// 开始执行磁盘 disk 的块设备请求 req，由中断驱动完成传输
+i32 ata_pio_request(ata_disk_t *disk, request_t *req) {
+    ASSERT_IRQ_DISABLE();       // 保证为外中断禁止
+    assert(disk->request == NULL);
+    assert(req->total > 0 && req->total <= ATA_SECTOR_MAX);
+
+    disk->request = req;
+    ata_bus_start(disk->bus);
+
+    // 如果是初始化时调用硬盘读写功能，则使用同步方式
+    if (current_task()->state != TASK_RUNNING) {
+        ata_bus_poll(disk->bus);
+    }
     return 0;
 }
 
@@ -267,6 +747,8 @@ i32 ata_pio_ioctl(ata_disk_t *disk, dev_cmd_t cmd, void *args, i32 flags) {
         return 0;
     case DEV_CMD_SECTOR_COUNT:
         return disk->total_lba;
+    case DEV_CMD_SECTOR_MAX:
+        return ATA_SECTOR_MAX;
     default:
         panic("Unknown device command %d...", cmd);
         break;
@@ -284,26 +766,20 @@ i32 ata_pio_partition_write(ata_partition_t *part, void *buf, u8 count, size_t l
 }
 
 // 发送分区控制命令，获取对应信息
-i32 ata_pio_partition_ioctl(ata_partition_t part, dev_cmd_t cmd, void *args, i32 flags) {
+i32 ata_pio_partition_ioctl(ata_partition_t *part, dev_cmd_t cmd, void *args, i32 flags) {
     switch (cmd) {
     case DEV_CMD_SECTOR_START:
-        return part.start_lba;
+        return part->start_lba;
     case DEV_CMD_SECTOR_COUNT:
-        return part.count;
+        return part->count;
+    case DEV_CMD_SECTOR_MAX:
+        return ATA_SECTOR_MAX;
     default:
         panic("Unknown device command %d...", cmd);
         break;
     }
 }
 
-// 软件方法重置驱动器
-static void ata_reset_derive(ata_bus_t *bus) {
-    outb(bus->ctlbase + ATA_CTL_DEV_CONTROL, ATA_CTRL_SRST);
-    ata_busy_wait(bus, ATA_SR_NULL);
-    outb(bus->ctlbase + ATA_CTL_DEV_CONTROL, 0);
-    ata_busy_wait(bus, ATA_SR_NULL);
-}
-
 // 字节序由 ATA string 转 C string
 static void ata_swap_words(u8 *buf, size_t len) {
     for (size_t i = 0; i < len; i += 2) {
@@ -361,6 +837,14 @@ static i32 ata_identify(ata_disk_t *disk, u16 *buf) {
     ata_swap_words(data->model, sizeof(data->model));
     LOGK("disk %s model number %s\n", disk->name, data->model);
 
+    // DMA supported
+    disk->dma = (data->capabilities & 0x100) != 0;
+    LOGK("disk %s DMA %s\n", disk->name, disk->dma ? "supported" : "unsupported");
+
+    // READ/WRITE MULTIPLE supported
+    ata_set_multiple(disk, data->drq_sectors);
+    LOGK("disk %s multiple sectors %d\n", disk->name, disk->multiple);
+
     ret = 0;
 
 rollback:
@@ -368,6 +852,63 @@ rollback:
     return ret;
 }
 
+#if ATA_PIO_BENCH
+// PIO 读扇区微基准测试的扇区数量
+#define ATA_BENCH_SECTORS 64
+
+// 读取时间戳计数器的低 32 位
+static u32 ata_rdtsc() {
+    u32 low, high;
+    asm volatile("rdtsc\n" : "=a"(low), "=d"(high));
+    return low;
+}
+
+// 逐字读取一个扇区，作为 rep insw 的对照组
+static void ata_pio_read_sector_word(ata_disk_t *disk, u16 *buf) {
+    for (size_t i = 0; i < (SECTOR_SIZE / sizeof(u16)); i++) {
+        buf[i] = inw(disk->bus->iobase + ATA_IO_DATA);
+    }
+}
+
+// 使用 read 读取磁盘开头的扇区，返回平均每个扇区数据传输消耗的时钟周期数
+static u32 ata_pio_bench_read(ata_disk_t *disk, u16 *buf, void (*read)(ata_disk_t *, u16 *)) {
+    ata_bus_t *bus = disk->bus;
+    u32 cycles = 0;
+
+    ata_select_disk(disk);
+    if (ata_busy_wait(bus, ATA_SR_DRDY) == ATA_SR_ERR) {
+        return 0;
+    }
+    ata_select_sector(disk, 0, ATA_BENCH_SECTORS);
+    outb(bus->iobase + ATA_IO_COMMAND, ATA_CMD_READ);
+
+    // 只统计数据传输的时间，不包括等待磁盘准备数据的时间
+    for (size_t i = 0; i < ATA_BENCH_SECTORS; i++) {
+        if (ata_busy_wait(bus, ATA_SR_DRQ) == ATA_SR_ERR) {
+            return 0;
+        }
+        u32 start = ata_rdtsc();
+        read(disk, buf);
+        cycles += ata_rdtsc() - start;
+    }
+    return cycles / ATA_BENCH_SECTORS;
+}
+
+// 比较逐字读取与 rep insw 读取一个扇区所需的时钟周期数
+static void ata_pio_bench(ata_disk_t *disk, u16 *buf) {
+    if (disk->total_lba == 0) {
+        return;
+    }
+
+    mutexlock_acquire(&disk->bus->lock);
+    u32 word = ata_pio_bench_read(disk, buf, ata_pio_read_sector_word);
+    u32 string = ata_pio_bench_read(disk, buf, ata_pio_read_sector);
+    mutexlock_release(&disk->bus->lock);
+
+    LOGK("disk %s PIO cycles per sector: inw %d, rep insw %d\n", disk->name, word, string);
+}
+#endif
+
 // 磁盘分区
 static void ata_partition(ata_disk_t *disk, u16 *buf) {
     // 如果磁盘不可用
@@ -424,8 +965,10 @@ static void ata_partition(ata_disk_t *disk, u16 *buf) {
     }
 }
 
-// 安装块设备
+// 安装块设备，磁盘设备安装后通过其请求队列读取分区表，再安装分区设备
 static void ata_device_install() {
+    u16 *buf = (u16 *)kalloc_page(1);
+
     for (size_t bidx = 0; bidx < ATA_BUS_NR; bidx++) {
         ata_bus_t *bus = &buses[bidx];
         
@@ -437,19 +980,28 @@ static void ata_device_install() {
             // 安装磁盘设备
             devid_t dev_id = dev_install(DEV_BLOCK, DEV_ATA_DISK, disk, disk->name, -1, 
                                          ata_pio_ioctl, ata_pio_read, ata_pio_write);
+            disk->dev_id = dev_id;
+            // 磁盘请求由中断驱动异步完成，并使用截止时间调度算法，保证读请求不会被持续的写请求饿死
+            dev_install_request(dev_id, ata_pio_request);
+            dev_ioctl(dev_id, DEV_CMD_SCHEDULER, (void *)IOSCHED_DEADLINE, 0);
+
+            ata_partition(disk, buf);
+            memset((void *)buf, 0, PAGE_SIZE);
 
             for (size_t pidx = 0; pidx < ATA_PARTITION_NR; pidx++) {
                 ata_partition_t *part = &disk->parts[pidx];
 
                 // 分区不存在
                 if (part->count == 0) continue;
-                // 安装分区设备
+                // 安装分区设备，分区的请求会转换为对磁盘的请求
                 dev_install(DEV_BLOCK, DEV_ATA_PART, part, part->name, dev_id, 
                             ata_pio_partition_ioctl, ata_pio_partition_read, 
                             ata_pio_partition_write);
             }
         }
     }
+
+    kfree_page((u32)buf, 1);
 }
 
 // 硬盘中断处理
@@ -466,10 +1018,40 @@ void ata_handler(int vector) {
     u8 state = inb(bus->iobase + ATA_IO_STATUS);
     LOGK("hard disk interrupt vector %d state 0x%x\n", vector, state);
 
-    // 如果有等待中断的进程，则取消它的阻塞
-    if (bus->waiter) {
-        task_unblock(bus->waiter);
-        bus->waiter = NULL;
+    // 如果总线正在复位，则检测复位是否完成
+    if (bus->resetting) {
+        ata_reset_check(bus);
+        return;
+    }
+
+    // 如果总线上有正在传输的请求，则继续传输
+    if (bus->request) {
+        ata_bus_intr(bus, state);
+    }
+}
+
+// 时钟中断时检测总线上等待驱动器就绪的步骤，驱动器就绪时不产生中断，无需等待超时检测线程
+void ata_clock() {
+    for (size_t i = 0; i < ATA_BUS_NR; i++) {
+        ata_bus_t *bus = &buses[i];
+        if (bus->pending) {
+            ata_bus_resume(bus);
+        }
+    }
+}
+
+// 磁盘超时检测线程 ata，处理丢失的中断和无响应的驱动器
+void ata_thread() {
+    irq_enable();
+
+    while (true) {
+        sleep(ATA_WATCHDOG);
+
+        u32 irq = irq_disable();
+        for (size_t i = 0; i < ATA_BUS_NR; i++) {
+            ata_bus_watchdog(&buses[i]);
+        }
+        set_irq_state(irq);
     }
 }
 
@@ -481,7 +1063,16 @@ static void ata_bus_init() {
         sprintf(bus->name, "ata%u", bidx);
         mutexlock_init(&bus->lock);
         bus->active = NULL;
-        bus->waiter = NULL;
+        bus->request = NULL;
+        bus->sector = 0;
+        bus->bmbase = 0;
+        bus->prdt = NULL;
+        bus->dma = false;
+        bus->expires = 0;
+        bus->retries = 0;
+        bus->resetting = false;
+        bus->pending = ATA_PENDING_NONE;
+        bus->setup = 0;
 
         if (bidx == 0) {
             // Primary bus
@@ -497,6 +1088,8 @@ static void ata_bus_init() {
             ata_disk_t *disk = &bus->disks[didx];
             sprintf(disk->name, "hdd%c", 'a' + bidx*ATA_BUS_NR + didx);
             disk->bus = bus;
+            disk->request = NULL;
+            disk->dma = false;
 
             if (didx == 0) {
                 // Master disk
@@ -510,18 +1103,42 @@ static void ata_bus_init() {
 
             ata_identify(disk, buf);
             memset((void *)buf, 0, PAGE_SIZE);
-            ata_partition(disk, buf);
-            memset((void *)buf, 0, PAGE_SIZE);
+#if ATA_PIO_BENCH
+            ata_pio_bench(disk, buf);
+#endif
         }
     }
 
     kfree_page((u32)buf, 1);
 }
 
+// 查找 PCI IDE 控制器，为每条总线设置总线主控 DMA，不存在时使用 PIO 传输
+static void ata_dma_init() {
+    pci_device_t *device = pci_find_class(PCI_CLASS_STORAGE, PCI_SUBCLASS_IDE, 0);
+
+    // 编程接口第 7 位表示支持总线主控，第 4 个基址寄存器为总线主控寄存器的 I/O 基址
+    u32 bmbase = device ? pci_inl(device, PCI_CONF_BASE_ADDR0 + ATA_BM_BAR * 4) : 0;
+    if (device == NULL || !(device->classcode & 0x80) || !(bmbase & PCI_BAR_TYPE_IO)) {
+        LOGK("IDE bus master DMA unavailable, use PIO\n");
+        return;
+    }
+    bmbase &= ~0x3;
+
+    // 主通道占用前 8 个端口，从通道占用后 8 个端口
+    pci_enable_busmaster(device);
+    for (size_t bidx = 0; bidx < ATA_BUS_NR; bidx++) {
+        ata_bus_t *bus = &buses[bidx];
+        bus->bmbase = bmbase + bidx * 8;
+        bus->prdt = (ata_prd_t *)kalloc_page(1);
+        LOGK("bus %s bus master base 0x%x\n", bus->name, bus->bmbase);
+    }
+}
+
 // ATA 总线和磁盘初始化
 void ata_init() {
     LOGK("ata init...\n");
     ata_bus_init();
+    ata_dma_init();
     ata_device_install();
 
     // 注册硬盘中断，并取消对应的屏蔽字
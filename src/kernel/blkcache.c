@@ -0,0 +1,389 @@
+#include <xos/blkcache.h>
+#include <xos/device.h>
+#include <xos/interrupt.h>
+#include <xos/memory.h>
+#include <xos/arena.h>
+#include <xos/string.h>
+#include <xos/assert.h>
+#include <xos/debug.h>
+#include <xos/stdlib.h>
+#include <xos/syscall.h>
+
+// 启动时创建的写回缓存设备 cache0 的后备设备名和缓存设备名，编译时通过 -DCACHE_BACKING=... 和 -DCACHE_DEVICE=... 指定
+#ifndef CACHE_BACKING
+#define CACHE_BACKING ""
+#endif
+
+#ifndef CACHE_DEVICE
+#define CACHE_DEVICE ""
+#endif
+
+// 写回脏块失败后重试的间隔 (毫秒)
+#define CACHE_RETRY_DELAY 1000
+
+#define CACHE_BLOCK_BYTES (CACHE_BLOCK_SECS * SECTOR_SIZE)
+
+// 块映射项是否为脏块
+#define cache_dirty(value) ((value) != CACHE_INVALID && ((value) & CACHE_DIRTY))
+
+// 由 cache 线程服务的写回缓存设备 (只支持一个)
+static blkcache_t *blkcache;
+
+// 发送写回缓存设备控制命令，获取对应信息
+static i32 cache_ioctl(blkcache_t *cache, dev_cmd_t cmd, void *args, i32 flags) {
+    switch (cmd) {
+    case DEV_CMD_SECTOR_START:
+        return 0;
+    case DEV_CMD_SECTOR_COUNT:
+        return cache->sectors;
+    case DEV_CMD_SECTOR_MAX:
+        return DEV_MERGE_MAX;
+    default:
+        panic("Unknown device command %d...", cmd);
+        break;
+    }
+}
+
+// 缓存块 entry 的序号
+static _inline u32 cache_slot(blkcache_t *cache, list_node_t *node) {
+    return element_entry(cache_block_t, node, node) - cache->entries;
+}
+
+// 查找缓存后备块 block 的缓存块，没有则返回 CACHE_INVALID
+static u32 cache_lookup(blkcache_t *cache, u32 block) {
+    u32 slot = cache->hash[block % CACHE_HASH_NR];
+    while (slot != CACHE_INVALID && (cache->map[slot] & ~CACHE_DIRTY) != block) {
+        slot = cache->entries[slot].next;
+    }
+    return slot;
+}
+
+// 将缓存块 slot 加入后备块号对应的哈希链表
+static void cache_hash(blkcache_t *cache, u32 slot) {
+    u32 *head = &cache->hash[(cache->map[slot] & ~CACHE_DIRTY) % CACHE_HASH_NR];
+    cache->entries[slot].next = *head;
+    *head = slot;
+}
+
+// 将缓存块 slot 移出后备块号对应的哈希链表
+static void cache_unhash(blkcache_t *cache, u32 slot) {
+    u32 *ptr = &cache->hash[(cache->map[slot] & ~CACHE_DIRTY) % CACHE_HASH_NR];
+    while (*ptr != slot) {
+        ptr = &cache->entries[*ptr].next;
+    }
+    *ptr = cache->entries[slot].next;
+}
+
+// 将缓存块 slot 移到 LRU 链表头部
+static void cache_promote(blkcache_t *cache, u32 slot) {
+    list_node_t *node = &cache->entries[slot].node;
+    list_remove(node);
+    list_push_front(&cache->lru, node);
+}
+
+// 更新缓存块 slot 的块映射项，并写入缓存设备上该项所在的扇区
+static i32 cache_update(blkcache_t *cache, u32 slot, u32 value) {
+    if (cache_dirty(cache->map[slot])) cache->dirty--;
+    if (cache_dirty(value)) cache->dirty++;
+    cache->map[slot] = value;
+
+    size_t sector = slot / CACHE_MAP_PER_SECTOR;
+    return dev_request(cache->cache, (u8 *)cache->map + sector * SECTOR_SIZE, 1, 1 + sector, 0, REQ_WRITE);
+}
+
+// 读写缓存设备上的缓存块 slot
+static i32 cache_io(blkcache_t *cache, u32 slot, void *buf, req_type_t type) {
+    return dev_request(cache->cache, buf, CACHE_BLOCK_SECS,
+                       cache->data_start + slot * CACHE_BLOCK_SECS, 0, type);
+}
+
+// 读写后备设备上的块 block
+static i32 backing_io(blkcache_t *cache, u32 block, void *buf, req_type_t type) {
+    return dev_request(cache->backing, buf, CACHE_BLOCK_SECS, block * CACHE_BLOCK_SECS, 0, type);
+}
+
+// 将脏的缓存块 slot 写回后备设备
+static i32 cache_destage(blkcache_t *cache, u32 slot) {
+    u32 block = cache->map[slot] & ~CACHE_DIRTY;
+    u8 *data = cache->buf + CACHE_BLOCK_BYTES;
+    if (cache_io(cache, slot, data, REQ_READ) < 0) return EOF;
+    if (backing_io(cache, block, data, REQ_WRITE) < 0) return EOF;
+    return cache_update(cache, slot, block);
+}
+
+// 分配一个无效的缓存块，优先淘汰 LRU 链表尾部的干净块，没有干净块时先写回最久未使用的脏块
+// 淘汰有效块时先将其映射项置为无效，保证缓存设备上的映射项不会指向被覆盖的数据
+static u32 cache_alloc(blkcache_t *cache) {
+    list_node_t *node = cache->lru.tail.prev;
+    while (node != &cache->lru.head && cache_dirty(cache->map[cache_slot(cache, node)])) {
+        node = node->prev;
+    }
+
+    u32 slot;
+    if (node == &cache->lru.head) {
+        slot = cache_slot(cache, cache->lru.tail.prev);
+        if (cache_destage(cache, slot) < 0) return CACHE_INVALID;
+    } else {
+        slot = cache_slot(cache, node);
+    }
+
+    if (cache->map[slot] != CACHE_INVALID) {
+        cache_unhash(cache, slot);
+        if (cache_update(cache, slot, CACHE_INVALID) < 0) return CACHE_INVALID;
+    }
+    return slot;
+}
+
+// 缓存块 slot 的数据写入后，建立到后备块的映射 value
+static i32 cache_insert(blkcache_t *cache, u32 slot, u32 value) {
+    i32 ret = cache_update(cache, slot, value);
+    cache_hash(cache, slot);
+    cache_promote(cache, slot);
+    return ret;
+}
+
+// 读取后备块 block 中从第 offset 个扇区开始的 secs 个扇区到 buf
+// 命中时只读取缓存设备，未命中时从后备设备读取整块，并将其提升到缓存中
+static i32 cache_read_block(blkcache_t *cache, u32 block, u8 *buf, size_t offset, size_t secs) {
+    u32 slot = cache_lookup(cache, block);
+    if (slot != CACHE_INVALID) {
+        cache_promote(cache, slot);
+        if (secs == CACHE_BLOCK_SECS) {
+            return cache_io(cache, slot, buf, REQ_READ);
+        }
+        if (cache_io(cache, slot, cache->buf, REQ_READ) < 0) return EOF;
+        memcpy(buf, cache->buf + offset * SECTOR_SIZE, secs * SECTOR_SIZE);
+        return 0;
+    }
+
+    if (backing_io(cache, block, cache->buf, REQ_READ) < 0) return EOF;
+    memcpy(buf, cache->buf + offset * SECTOR_SIZE, secs * SECTOR_SIZE);
+
+    // 提升失败不影响读取的结果
+    slot = cache_alloc(cache);
+    if (slot != CACHE_INVALID && cache_io(cache, slot, cache->buf, REQ_WRITE) == 0) {
+        cache_insert(cache, slot, block);
+    }
+    return 0;
+}
+
+// 将 buf 写入后备块 block 中从第 offset 个扇区开始的 secs 个扇区，只写入缓存设备并标记为脏块
+static i32 cache_write_block(blkcache_t *cache, u32 block, u8 *buf, size_t offset, size_t secs) {
+    u32 slot = cache_lookup(cache, block);
+    bool hit = slot != CACHE_INVALID;
+    if (!hit) {
+        slot = cache_alloc(cache);
+        if (slot == CACHE_INVALID) return EOF;
+    }
+
+    // 不完整的块需要先读出原有数据再合并
+    u8 *data = buf;
+    if (secs != CACHE_BLOCK_SECS) {
+        i32 ret = hit ? cache_io(cache, slot, cache->buf, REQ_READ)
+                      : backing_io(cache, block, cache->buf, REQ_READ);
+        if (ret < 0) return EOF;
+        memcpy(cache->buf + offset * SECTOR_SIZE, buf, secs * SECTOR_SIZE);
+        data = cache->buf;
+    }
+
+    // 新分配的缓存块先写入数据再建立映射，已缓存的干净块先标记为脏块再写入数据
+    if (!hit) {
+        if (cache_io(cache, slot, data, REQ_WRITE) < 0) return EOF;
+        return cache_insert(cache, slot, block | CACHE_DIRTY);
+    }
+
+    cache_promote(cache, slot);
+    if (!cache_dirty(cache->map[slot])) {
+        if (cache_update(cache, slot, block | CACHE_DIRTY) < 0) return EOF;
+    }
+    return cache_io(cache, slot, data, REQ_WRITE);
+}
+
+// 执行请求 req (包括合并的请求)，按照缓存块边界拆分
+static i32 cache_do_request(blkcache_t *cache, request_t *req) {
+    if (req->idx >= cache->sectors || req->total > cache->sectors - req->idx) {
+        return EOF;
+    }
+
+    for (request_t *ptr = req; ptr; ptr = ptr->next) {
+        u8 *buf = (u8 *)ptr->buf;
+        size_t lba = ptr->idx;
+        size_t count = ptr->count;
+        while (count > 0) {
+            u32 block = lba / CACHE_BLOCK_SECS;
+            size_t offset = lba % CACHE_BLOCK_SECS;
+            size_t secs = MIN(count, CACHE_BLOCK_SECS - offset);
+
+            i32 ret = req->type == REQ_READ ? cache_read_block(cache, block, buf, offset, secs)
+                                            : cache_write_block(cache, block, buf, offset, secs);
+            if (ret < 0) return EOF;
+
+            buf += secs * SECTOR_SIZE;
+            lba += secs;
+            count -= secs;
+        }
+    }
+    return 0;
+}
+
+// 开始执行写回缓存设备的请求 req，由 cache 线程执行 (需要阻塞等待缓存设备和后备设备)
+static i32 cache_request(blkcache_t *cache, request_t *req) {
+    assert(cache->request == NULL);
+    cache->request = req;
+    if (cache->waiter) {
+        task_unblock(cache->waiter);
+        cache->waiter = NULL;
+    }
+    return 0;
+}
+
+// 写回缓存线程 cache，优先执行请求，空闲时将最久未使用的脏块写回后备设备
+void cache_thread() {
+    irq_enable();
+
+    while (true) {
+        u32 irq = irq_disable();
+        blkcache_t *cache = blkcache;
+        bool failed = false;
+
+        if (cache && cache->request) {
+            request_t *req = cache->request;
+            i32 ret = cache_do_request(cache, req);
+            cache->request = NULL;
+            request_complete(req, ret);
+        } else if (cache && cache->dirty > 0) {
+            list_node_t *node = cache->lru.tail.prev;
+            while (!cache_dirty(cache->map[cache_slot(cache, node)])) {
+                node = node->prev;
+            }
+            failed = cache_destage(cache, cache_slot(cache, node)) < 0;
+        } else {
+            // 没有配置写回缓存设备时永久阻塞
+            if (cache) cache->waiter = current_task();
+            task_block(current_task(), NULL, TASK_BLOCKED);
+        }
+
+        set_irq_state(irq);
+        if (failed) {
+            LOGK("cache %s destage failed...\n", cache->name);
+            sleep(CACHE_RETRY_DELAY);
+        }
+    }
+}
+
+// 读写缓存设备上从第 1 个扇区开始的块映射
+static i32 cache_map_io(blkcache_t *cache, size_t count, bool write) {
+    for (size_t i = 0; i < count; i += DEV_MERGE_MAX) {
+        size_t secs = MIN(DEV_MERGE_MAX, count - i);
+        u8 *buf = (u8 *)cache->map + i * SECTOR_SIZE;
+        i32 ret = write ? dev_write(cache->cache, buf, secs, 1 + i, 0)
+                        : dev_read(cache->cache, buf, secs, 1 + i, 0);
+        if (ret < 0) return EOF;
+    }
+    return 0;
+}
+
+// 以 cache 设备缓存 backing 设备，创建写回缓存块设备 name，失败返回 EOF
+// 缓存设备上保存的元数据与后备设备匹配时恢复块映射 (包括尚未写回的脏块)，否则重新初始化
+devid_t blkcache_install(char *name, devid_t backing, devid_t cache_dev) {
+    if (blkcache) {
+        return EOF;
+    }
+
+    size_t csecs = dev_ioctl(cache_dev, DEV_CMD_SECTOR_COUNT, NULL, 0);
+    size_t blocks = csecs > 0 ? (csecs - 1) / CACHE_BLOCK_SECS : 0;
+    while (blocks > 0 && 1 + div_round_up(blocks, CACHE_MAP_PER_SECTOR) + blocks * CACHE_BLOCK_SECS > csecs) {
+        blocks--;
+    }
+    if (blocks == 0) {
+        LOGK("cache %s device too small...\n", name);
+        return EOF;
+    }
+
+    blkcache_t *cache = (blkcache_t *)kmalloc(sizeof(blkcache_t));
+    strncpy(cache->name, name, sizeof(cache->name));
+    cache->backing = backing;
+    cache->cache = cache_dev;
+    cache->sectors = dev_ioctl(backing, DEV_CMD_SECTOR_COUNT, NULL, 0);
+    cache->sectors -= cache->sectors % CACHE_BLOCK_SECS;
+    cache->blocks = blocks;
+    cache->dirty = 0;
+    cache->request = NULL;
+    cache->waiter = NULL;
+
+    size_t map_secs = div_round_up(blocks, CACHE_MAP_PER_SECTOR);
+    cache->data_start = 1 + map_secs;
+    size_t map_pages = div_round_up(map_secs * SECTOR_SIZE, PAGE_SIZE);
+    size_t entry_pages = div_round_up(blocks * sizeof(cache_block_t), PAGE_SIZE);
+    size_t hash_pages = div_round_up(CACHE_HASH_NR * sizeof(u32), PAGE_SIZE);
+    cache->map = (u32 *)kalloc_page(map_pages);
+    cache->entries = (cache_block_t *)kalloc_page(entry_pages);
+    cache->hash = (u32 *)kalloc_page(hash_pages);
+    cache->buf = (u8 *)kalloc_page(1);
+    memset(cache->hash, 0xff, CACHE_HASH_NR * sizeof(u32));
+    memset(cache->map, 0xff, map_secs * SECTOR_SIZE);
+
+    cache_header_t *header = (cache_header_t *)cache->buf;
+    bool valid = dev_read(cache_dev, header, 1, 0, 0) == 0 && header->magic == CACHE_MAGIC &&
+                 header->sectors == cache->sectors && header->blocks == blocks &&
+                 cache_map_io(cache, map_secs, false) == 0;
+    if (!valid) {
+        memset(cache->map, 0xff, map_secs * SECTOR_SIZE);
+        memset(cache->buf, 0, SECTOR_SIZE);
+        header->magic = CACHE_MAGIC;
+        header->sectors = cache->sectors;
+        header->blocks = blocks;
+        if (dev_write(cache_dev, header, 1, 0, 0) < 0 || cache_map_io(cache, map_secs, true) < 0) {
+            LOGK("cache %s write metadata failed...\n", name);
+            kfree_page((u32)cache->map, map_pages);
+            kfree_page((u32)cache->entries, entry_pages);
+            kfree_page((u32)cache->hash, hash_pages);
+            kfree_page((u32)cache->buf, 1);
+            kfree(cache);
+            return EOF;
+        }
+    }
+
+    // 有效的缓存块加入 LRU 链表头部，无效的缓存块加入尾部以便优先分配
+    list_init(&cache->lru);
+    for (u32 slot = 0; slot < blocks; slot++) {
+        list_node_t *node = &cache->entries[slot].node;
+        node->prev = node->next = NULL;
+        if (cache->map[slot] == CACHE_INVALID) {
+            list_push_back(&cache->lru, node);
+            continue;
+        }
+        list_push_front(&cache->lru, node);
+        cache_hash(cache, slot);
+        if (cache_dirty(cache->map[slot])) cache->dirty++;
+    }
+
+    cache->dev_id = dev_install(DEV_BLOCK, DEV_CACHE, cache, cache->name, -1, cache_ioctl, NULL, NULL);
+    dev_install_request(cache->dev_id, cache_request);
+    blkcache = cache;
+
+    LOGK("cache %s blocks %d dirty %d %s\n", cache->name, blocks, cache->dirty,
+         valid ? "recovered" : "initialized");
+    return cache->dev_id;
+}
+
+// 根据 CACHE_BACKING 和 CACHE_DEVICE 配置的设备名创建写回缓存设备 cache0
+void blkcache_init() {
+    char *names[2] = {CACHE_BACKING, CACHE_DEVICE};
+    devid_t devs[2];
+
+    if (!*names[0] || !*names[1]) {
+        return;
+    }
+
+    for (size_t i = 0; i < 2; i++) {
+        dev_t *dev = dev_find_name(names[i]);
+        if (dev == NULL || dev->type != DEV_BLOCK) {
+            LOGK("cache device %s not found...\n", names[i]);
+            return;
+        }
+        devs[i] = dev->dev_id;
+    }
+
+    blkcache_install("cache0", devs[0], devs[1]);
+}
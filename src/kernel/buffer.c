@@ -3,56 +3,287 @@
 #include <xos/device.h>
 #include <xos/assert.h>
 #include <xos/debug.h>
+#include <xos/stdlib.h>
+#include <xos/interrupt.h>
+#include <xos/syscall.h>
+#include <xos/string.h>
+#include <xos/mutex.h>
+#include <xos/arena.h>
+#include <xos/xos.h>
 
-#define HASH_COUNT 31   // 哈希表容量
+#define HASH_MIN_BITS 8     // 哈希表初始桶数的位数 (256 个桶，恰好占用一页)
+#define HASH_GOLDEN 0x9e3779b1  // 黄金分割乘数，用于打散哈希值
+
+#define BUFFER_PER_PAGE (PAGE_SIZE / BLOCK_SIZE)    // 每页内存容纳的缓存个数
+#define BUFFER_MIN      64      // 高速缓存的最少个数，回收内存时不会低于该值
+#define BUFFER_RESERVE  512     // 高速缓存扩容时至少保留的内核空闲页数 (2M)
+
+#define FLUSH_INTERVAL  500     // 回写线程的唤醒周期 (ms)
+#define FLUSH_EXPIRE    3000    // 脏缓存的最长驻留时间 (ms)，超过后会被回写
+#define FLUSH_RATIO     10      // 脏缓存占比 (%) 超过该值时立即唤醒回写线程
+#define FLUSH_BATCH     32      // 回写线程每批写回的最大缓存数
+
+#define READAHEAD_NR    64      // 预读队列的容量
+
+#define CLUSTER_MAX     32      // 一次合并读取的最大块数
+
+// 高速缓存替换策略，编译时通过 -DBUFFER_POLICY=... 选择
+#define POLICY_LRU      0       // LRU，最近最少使用
+#define POLICY_2Q       1       // 2Q，抗顺序扫描
+
+#ifndef BUFFER_POLICY
+#define BUFFER_POLICY   POLICY_2Q
+#endif
+
+#define A1IN_RATIO      25      // 2Q：A1in 队列 (首次访问的块) 的目标占比 (%)
+#define GHOST_PAGES     4       // 2Q：A1out 影子队列占用的页数
+#define GHOST_BITS      8       // 2Q：A1out 影子哈希表桶数的位数
+
+extern u32 volatile jiffies;
+extern const u32 jiffy;
 
-// 高速缓存的起始地址
-static uptr buffer_base = (uptr)KERNEL_BUFFER_BASE;
-// 高速缓存的当前待分配地址
-static buffer_t *buffer_ptr  = (buffer_t *)KERNEL_BUFFER_BASE;
-// 高速缓存数据区的当前待分配地址
-static uptr buffer_data = (uptr)(KERNEL_BUFFER_BASE + KERNEL_BUFFER_SIZE - BLOCK_SIZE);
 // 高速缓存分配个数
 static size_t buff_cnt = 0;
-
-static list_t hash_table[HASH_COUNT];   // 高速缓存哈希表
+// 备用链表，已分配内存但尚未对应任何块的缓存
+static list_t spare_list;
+// 高速缓存是否正在扩容，此时不响应内存回收
+static bool growing = false;
+
+static list_t *hash_table;  // 高速缓存哈希表
+static size_t hash_bits;    // 哈希表桶数的位数，桶数为 (1 << hash_bits)
+#if BUFFER_POLICY == POLICY_2Q
+static list_t a1_list;      // 2Q：A1in 空闲链表，只被访问过一次的块
+static list_t am_list;      // 2Q：Am 空闲链表，被反复访问的热块
+static size_t a1_cnt;       // 2Q：A1in 中的缓存个数 (包括正在被引用的缓存)
+#else
 static list_t free_list;    // 空闲链表
+#endif
 static list_t wait_list;    // 等待链表
+static buffer_stat_t stat;  // 高速缓存统计信息
+static list_t dirty_list;   // 脏链表 (按照变脏的时间先后排列)
+static size_t dirty_cnt;    // 脏缓存个数
+static task_t *flush_task;  // 回写线程
+
+// 预读请求
+typedef struct readahead_t {
+    devid_t dev_id;     // 设备号
+    size_t block;       // 块号
+} readahead_t;
+
+static readahead_t ra_queue[READAHEAD_NR];  // 预读队列 (环形队列)
+static size_t ra_head;      // 预读队列中下一个待处理的请求
+static size_t ra_tail;      // 预读队列中下一个请求的插入位置
+static task_t *ra_task;     // 预读线程
+static bool ra_idle;        // 预读线程是否因为没有请求而阻塞
+
+
+#if BUFFER_POLICY == POLICY_2Q
+// 2Q：A1out 影子队列项，记录最近从 A1in 淘汰的块，再次访问时直接进入 Am
+typedef struct ghost_t {
+    devid_t dev_id;     // 设备号
+    size_t block;       // 块号
+    list_node_t hnode;  // 影子哈希表拉链节点
+} ghost_t;
+
+#define GHOST_NR (GHOST_PAGES * PAGE_SIZE / sizeof(ghost_t))    // 影子队列容量
+
+static ghost_t *ghosts;         // 影子队列 (环形队列)
+static size_t ghost_next;       // 影子队列中下一个被覆盖的项
+static list_t *ghost_table;     // 影子哈希表
+#endif
+
+// 哈希表桶数
+#define HASH_COUNT (1 << hash_bits)
+
+// 哈希表占用的页数
+#define HASH_PAGES(bits) div_round_up((1 << (bits)) * sizeof(list_t), PAGE_SIZE)
+
+// 哈希函数 (Fibonacci Hashing)，将设备号和块号充分混合后取高 bits 位
+static size_t hash_key(devid_t dev_id, size_t block, size_t bits) {
+    u32 key = (block ^ ((u32)dev_id * HASH_GOLDEN)) * HASH_GOLDEN;
+    return key >> (32 - bits);
+}
 
-// 哈希函数
+// 高速缓存哈希表的哈希函数
 static size_t hash(devid_t dev_id, size_t block) {
-    return (dev_id ^ block) % HASH_COUNT;
+    return hash_key(dev_id, block, hash_bits);
+}
+
+// 分配拥有 (1 << bits) 个桶的哈希表
+static list_t *hash_alloc(size_t bits) {
+    list_t *table = (list_t *)kalloc_page(HASH_PAGES(bits));
+    for (size_t i = 0; i < (1 << bits); i++) {
+        list_init(&table[i]);
+    }
+    return table;
+}
+
+// 哈希表扩容，桶数翻倍，并将所有缓存重新散列到新表中
+static void hash_grow() {
+    list_t *old_table = hash_table;
+    size_t old_bits = hash_bits;
+
+    hash_table = hash_alloc(old_bits + 1);
+    hash_bits = old_bits + 1;
+
+    for (size_t i = 0; i < (1 << old_bits); i++) {
+        list_t *list = &old_table[i];
+        while (!list_empty(list)) {
+            buffer_t *bf = element_entry(buffer_t, hnode, list_pop_front(list));
+            list_insert_after(&hash_table[hash(bf->dev_id, bf->block)].head, &bf->hnode);
+        }
+    }
+
+    kfree_page((u32)old_table, HASH_PAGES(old_bits));
+    LOGK("buffer hash table grow to %d buckets\n", HASH_COUNT);
 }
 
 // 将 bf 加入哈希表
 static void hash_insert(buffer_t *bf) {
     size_t idx = hash(bf->dev_id, bf->block);
     list_t *list = &hash_table[idx];
-    assert(!list_contains(list, &bf->hnode));
-    list_push_front(list, &bf->hnode);
+    ASSERT_NODE_FREE(&bf->hnode);
+    list_insert_after(&list->head, &bf->hnode);
 }
 
 // 将 bf 从哈希表中移除
 static void hash_remove(buffer_t *bf) {
-    size_t idx = hash(bf->dev_id, bf->block);
-    list_t *list = &hash_table[idx];
-    assert(list_contains(list, &bf->hnode));
+    assert(bf->hnode.prev != NULL && bf->hnode.next != NULL);
     list_remove(&bf->hnode);
 } 
 
-// 在哈希表中获取设备号 dev_id 第 block 块对应缓存，如果没有直接返回 NULL
-static buffer_t *get_from_hash_table(devid_t dev_id, size_t block) {
+// 在哈希表中查找设备号 dev_id 第 block 块对应缓存，如果没有直接返回 NULL
+static buffer_t *hash_lookup(devid_t dev_id, size_t block) {
     size_t idx = hash(dev_id, block);
     list_t *list = &hash_table[idx];
-    buffer_t *bf = NULL;
 
     for (list_node_t *node = list->head.next; node != &list->tail; node = node->next) {
         buffer_t *ptr = element_entry(buffer_t, hnode, node);
         if (ptr->dev_id == dev_id && ptr->block == block) {
-            bf = ptr;
-            break;
+            return ptr;
+        }
+    }
+    return NULL;
+}
+
+#if BUFFER_POLICY == POLICY_2Q
+
+// 在影子队列中查找并移除设备号 dev_id 第 block 块对应的项，找到返回 true
+static bool ghost_take(devid_t dev_id, size_t block) {
+    list_t *list = &ghost_table[hash_key(dev_id, block, GHOST_BITS)];
+    for (list_node_t *node = list->head.next; node != &list->tail; node = node->next) {
+        ghost_t *ghost = element_entry(ghost_t, hnode, node);
+        if (ghost->dev_id == dev_id && ghost->block == block) {
+            list_remove(&ghost->hnode);
+            ghost->dev_id = EOF;
+            return true;
         }
     }
+    return false;
+}
+
+// 将从 A1in 淘汰的缓存 bf 记录到影子队列，覆盖最早的项
+static void ghost_insert(buffer_t *bf) {
+    ghost_t *ghost = &ghosts[ghost_next];
+    ghost_next = (ghost_next + 1) % GHOST_NR;
+
+    if (ghost->dev_id != EOF) {
+        list_remove(&ghost->hnode);
+    }
+    ghost->dev_id = bf->dev_id;
+    ghost->block = bf->block;
+    list_t *list = &ghost_table[hash_key(ghost->dev_id, ghost->block, GHOST_BITS)];
+    list_insert_after(&list->head, &ghost->hnode);
+}
+
+// 缓存 bf 被分配给新的块，确定其所属队列：最近从 A1in 淘汰过的块直接进入 Am，否则进入 A1in
+static void policy_assign(buffer_t *bf) {
+    if (ghost_take(bf->dev_id, bf->block)) {
+        bf->hot = true;
+        stat.promotions++;
+    } else {
+        bf->hot = false;
+        a1_cnt++;
+    }
+}
+
+// 缓存 bf 即将被淘汰
+static void policy_evict(buffer_t *bf) {
+    if (!bf->hot) {
+        assert(a1_cnt > 0);
+        a1_cnt--;
+        ghost_insert(bf);
+        stat.a1_evictions++;
+    } else {
+        stat.am_evictions++;
+    }
+}
+
+// 将引用计数为 0 的缓存 bf 加入空闲链表头部
+static void free_list_insert(buffer_t *bf) {
+    list_t *list = bf->hot ? &am_list : &a1_list;
+    ASSERT_NODE_FREE(&bf->rnode);
+    list_insert_after(&list->head, &bf->rnode);
+    bf->free = true;
+}
+
+// 从空闲链表尾部取出待淘汰的缓存，没有则返回 NULL
+// 当 A1in 超过目标占比时优先淘汰 A1in 中的块，这样顺序扫描的块不会挤出 Am 中的热块
+static buffer_t *free_list_pop() {
+    list_t *list = NULL;
+    if (!list_empty(&a1_list) && (a1_cnt * 100 > buff_cnt * A1IN_RATIO || list_empty(&am_list))) {
+        list = &a1_list;
+    } else if (!list_empty(&am_list)) {
+        list = &am_list;
+    } else {
+        return NULL;
+    }
+
+    buffer_t *bf = element_entry(buffer_t, rnode, list_pop_back(list));
+    bf->free = false;
+    return bf;
+}
+
+#else
+
+// 缓存 bf 被分配给新的块
+static void policy_assign(buffer_t *bf) {
+}
+
+// 缓存 bf 即将被淘汰
+static void policy_evict(buffer_t *bf) {
+}
+
+// 将引用计数为 0 的缓存 bf 加入空闲链表头部
+static void free_list_insert(buffer_t *bf) {
+    ASSERT_NODE_FREE(&bf->rnode);
+    list_insert_after(&free_list.head, &bf->rnode);
+    bf->free = true;
+}
+
+// 从空闲链表尾部取出最近最少被访问的缓存，没有则返回 NULL
+static buffer_t *free_list_pop() {
+    if (list_empty(&free_list)) {
+        return NULL;
+    }
+    buffer_t *bf = element_entry(buffer_t, rnode, list_pop_back(&free_list));
+    bf->free = false;
+    return bf;
+}
+
+#endif
+
+// 如果缓存 bf 在空闲链表中，则将其移出
+static void free_list_remove(buffer_t *bf) {
+    if (bf->free) {
+        list_remove(&bf->rnode);
+        bf->free = false;
+    }
+}
+
+// 在哈希表中获取设备号 dev_id 第 block 块对应缓存，如果没有直接返回 NULL
+static buffer_t *get_from_hash_table(devid_t dev_id, size_t block) {
+    buffer_t *bf = hash_lookup(dev_id, block);
 
     // 不在哈希表中
     if (bf == NULL) {
@@ -60,115 +291,474 @@ static buffer_t *get_from_hash_table(devid_t dev_id, size_t block) {
     }
 
     // 如果 bf 在空闲链表中，则移除出空闲链表
-    if (list_contains(&free_list, &bf->rnode)) {
-        list_remove(&bf->rnode);
-    }
+    free_list_remove(bf);
 
     return bf;
 }
 
-// 高速缓存 Lazy Allocation，如果没有多余空间，返回 NULL
-static buffer_t *get_new_buffer() {
-    buffer_t *bf = NULL;
-
-    if ((uptr)buffer_ptr + sizeof(buffer_t) < buffer_data) {
-        bf = (buffer_t *)buffer_ptr;
-        bf->data = (void *)buffer_data;
+// 高速缓存扩容，按需分配一页内存作为 BUFFER_PER_PAGE 个缓存加入备用链表
+// 内核空闲页不足时不进行扩容，返回 false
+static bool buffer_grow() {
+    if (buff_cnt >= BUFFER_MIN && kernel_free_pages() < BUFFER_RESERVE) {
+        return false;
+    }
+    growing = true;
+
+    // 同一页中的缓存的描述符连续存储，这样回收时可以由缓存找到整页
+    void *page = (void *)kalloc_page(1);
+    buffer_t *group = (buffer_t *)kmalloc(sizeof(buffer_t) * BUFFER_PER_PAGE);
+    for (size_t i = 0; i < BUFFER_PER_PAGE; i++) {
+        buffer_t *bf = &group[i];
+        bf->data = page + i * BLOCK_SIZE;
         bf->dev_id = -1;
         bf->block = 0;
         bf->count = 0;
-        mutexlock_init(&bf->lock);
-        bf->dirty = false;
-        bf->valid = false;
+        bf->hnode.prev = bf->hnode.next = NULL;
+        bf->rnode.prev = bf->rnode.next = NULL;
+        list_init(&bf->waiters);
+        bf->free = false;
+        bf->hot = false;
+        bf->dnode.prev = bf->dnode.next = NULL;
+        bf->dirty_time = 0;
+        bf->state = 0;
+        list_insert_after(&spare_list.head, &bf->rnode);
+    }
+    buff_cnt += BUFFER_PER_PAGE;
+    LOGK("buffer count %d\n", buff_cnt);
+
+    // 平均链长超过 1 时对哈希表进行扩容
+    if (buff_cnt > HASH_COUNT) {
+        hash_grow();
+    }
 
-        // 更新 buffer_ptr 和 buffer_data 所指地址
-        buffer_ptr++;
-        buffer_data -= BLOCK_SIZE;
+    growing = false;
+    return true;
+}
 
-        LOGK("buffer count %d\n", ++buff_cnt);
+// 从备用链表中获取缓存，必要时进行扩容，如果没有多余内存，返回 NULL
+static buffer_t *get_new_buffer() {
+    if (list_empty(&spare_list) && !buffer_grow()) {
+        return NULL;
     }
+    return element_entry(buffer_t, rnode, list_pop_front(&spare_list));
+}
 
-    return bf;
+// 获取缓存 bf 所在页的第一个缓存
+static buffer_t *buffer_group(buffer_t *bf) {
+    return bf - ((u32)bf->data & (PAGE_SIZE - 1)) / BLOCK_SIZE;
+}
+
+// 缓存 bf 是否没有被引用且干净，可以直接回收
+static bool buffer_idle(buffer_t *bf) {
+    if (bf->count > 0 || (bf->state & (BUF_LOCKED | BUF_DIRTY))) {
+        return false;
+    }
+    // 位于空闲链表中，或者位于备用链表中 (不在哈希表中)
+    return bf->free || bf->hnode.next == NULL;
+}
+
+// 回收从 group 开始的一页缓存，将内存归还给内核
+static void buffer_reclaim(buffer_t *group) {
+    for (size_t i = 0; i < BUFFER_PER_PAGE; i++) {
+        buffer_t *bf = &group[i];
+        assert(buffer_idle(bf) && list_empty(&bf->waiters));
+
+        if (bf->free) {
+            free_list_remove(bf);
+        } else {
+            list_remove(&bf->rnode);
+        }
+        if (bf->hnode.next) {
+            policy_evict(bf);
+            hash_remove(bf);
+            stat.evictions++;
+        }
+    }
+
+    kfree_page((u32)group->data, 1);
+    kfree(group);
+    buff_cnt -= BUFFER_PER_PAGE;
+    stat.reclaims++;
+}
+
+// 从链表 list 尾部开始回收整页都空闲的缓存，最多回收 count 页，返回回收的页数
+static u32 shrink_list(list_t *list, u32 count) {
+    u32 freed = 0;
+    list_node_t *node = list->tail.prev;
+    while (node != &list->head && freed < count && buff_cnt >= BUFFER_MIN + BUFFER_PER_PAGE) {
+        buffer_t *group = buffer_group(element_entry(buffer_t, rnode, node));
+        node = node->prev;
+
+        bool idle = true;
+        for (size_t i = 0; i < BUFFER_PER_PAGE && idle; i++) {
+            idle = buffer_idle(&group[i]);
+        }
+        if (!idle) continue;
+
+        // 跳过同一页中相邻的缓存，保证 node 在回收后仍然有效
+        while (node != &list->head && buffer_group(element_entry(buffer_t, rnode, node)) == group) {
+            node = node->prev;
+        }
+        buffer_reclaim(group);
+        freed++;
+    }
+    return freed;
+}
+
+// 内存回收函数，内核空闲页不足时由内存管理调用，回收最近最少使用的干净缓存
+static u32 buffer_shrink(u32 count) {
+    if (growing) {
+        return 0;
+    }
+
+    u32 irq = irq_disable();
+    u32 freed = shrink_list(&spare_list, count);
+#if BUFFER_POLICY == POLICY_2Q
+    freed += shrink_list(&a1_list, count - freed);
+    freed += shrink_list(&am_list, count - freed);
+#else
+    freed += shrink_list(&free_list, count - freed);
+#endif
+    set_irq_state(irq);
+
+    LOGK("buffer shrink %d pages, buffer count %d\n", freed, buff_cnt);
+    return freed;
 }
 
 // 获取空闲的 buffer
 static buffer_t *get_free_buffer() {
     buffer_t *bf = NULL;
     while (true) {
-        // 如果空闲内存足够，直接分配缓存
+        // 如果内存足够，直接分配缓存
         bf = get_new_buffer();
         if (bf) return bf;
         
-        // 否则从空闲链表中获取
-        if (!list_empty(&free_list)) {
-            // LRU 取最近最少被访问的块
-            bf = element_entry(buffer_t, rnode, list_pop_back(&free_list));
+        // 否则按照替换策略从空闲链表中获取
+        bf = free_list_pop();
+        if (bf) {
+            // 空闲缓存没有被任何任务引用，所以不可能处于加锁状态
+            assert(!(bf->state & BUF_LOCKED));
+
+            // 如果缓存为脏，则需要先写回，写回期间任务会阻塞，
+            // 此时缓存可能被其它任务重新引用或者再次修改，那么就放弃这块缓存
+            // 写回完成时释放 I/O 引用会将缓存重新加入空闲链表头部，需要将其移出后继续使用
+            if (bf->state & BUF_DIRTY) {
+                bwrite(bf);
+                if (bf->count > 0 || (bf->state & BUF_DIRTY)) {
+                    continue;
+                }
+                free_list_remove(bf);
+            }
+
             // 从哈希表移除
+            policy_evict(bf);
             hash_remove(bf);
+            stat.evictions++;
             // 进行设置
-            bf->valid = false;
+            bf->state = 0;
             return bf;
         }
 
         // 如果当前没有空闲块，则阻塞等待直到有块被释放
+        u32 start = jiffies;
+        stat.waits++;
         task_block(current_task(), &wait_list, TASK_BLOCKED);
+        stat.wait_time += jiffies - start;
     }
 }
 
 // 获取设备号 dev_id 第 block 块对应的缓存
 static buffer_t *getblk(devid_t dev_id, size_t block) {
+    stat.lookups++;
+
     // 先在哈希表中寻找，如果找到了则增加缓存引用计数
     buffer_t *bf = get_from_hash_table(dev_id, block);
     if (bf) {
         bf->count++;
+        stat.hits++;
         return bf;
     }
+    stat.misses++;
 
     // 否则获取空闲缓存
     bf = get_free_buffer();
     assert(bf->count == 0);
-    assert(bf->dirty == false);
+    assert(bf->state == 0);
 
     // 设置块并加入哈希表
     bf->dev_id = dev_id;
     bf->block = block;
     bf->count = 1;
     hash_insert(bf);
+    policy_assign(bf);
 
     return bf;
 }
 
-// 读取设备号 dev_id 的第 block 块数据到高速缓存
+// 缓存加锁，如果缓存已被其它任务加锁 (例如 I/O 进行中)，则阻塞等待直到解锁
+void buffer_lock(buffer_t *bf) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+
+    while (bf->state & BUF_LOCKED) {
+        task_block(current_task(), &bf->waiters, TASK_BLOCKED);
+    }
+    bf->state |= BUF_LOCKED;
+}
+
+// 尝试对缓存加锁，不阻塞等待，成功返回 true
+static bool buffer_trylock(buffer_t *bf) {
+    if (bf->state & BUF_LOCKED) {
+        return false;
+    }
+    bf->state |= BUF_LOCKED;
+    return true;
+}
+
+// 缓存解锁，并唤醒所有等待该缓存的任务
+void buffer_unlock(buffer_t *bf) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+    assert(bf->state & BUF_LOCKED);
+
+    bf->state &= ~BUF_LOCKED;
+    while (!list_empty(&bf->waiters)) {
+        task_t *task = element_entry(task_t, node, bf->waiters.head.next);
+        assert(task->magic == XOS_MAGIC); // 检测栈溢出
+        task_unblock(task);
+    }
+}
+
+// 等待缓存解锁 (即等待进行中的 I/O 完成)
+void buffer_wait(buffer_t *bf) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+
+    while (bf->state & BUF_LOCKED) {
+        task_block(current_task(), &bf->waiters, TASK_BLOCKED);
+    }
+}
+
+// 清除高速缓存 bf 的脏位，并移出脏链表
+static void bclean(buffer_t *bf) {
+    if (!(bf->state & BUF_DIRTY)) {
+        return;
+    }
+    bf->state &= ~BUF_DIRTY;
+    list_remove(&bf->dnode);
+    dirty_cnt--;
+}
+
+// 缓存的设备请求 req 完成 (通常位于中断处理中)，更新缓存状态，之后解锁缓存并释放 I/O 持有的引用
+static void buffer_end_io(request_t *req) {
+    buffer_t *bf = (buffer_t *)req->data;
+    bf->state &= ~BUF_IO;
+
+    if (req->ret < 0) {
+        LOGK("buffer I/O error device %d block %d\n", bf->dev_id, bf->block);
+        bf->state |= BUF_ERROR;
+        stat.errors++;
+
+        // 写回失败的数据仍只存在于缓存中，重新加入脏链表，由回写线程稍后重试
+        if (req->type == REQ_WRITE) {
+            bdirty(bf);
+        }
+    } else if (req->type == REQ_READ) {
+        bf->state &= ~BUF_ERROR;
+        bf->state |= BUF_UPTODATE;
+        stat.reads++;
+    } else {
+        bf->state &= ~BUF_ERROR;
+        stat.writebacks++;
+    }
+
+    buffer_unlock(bf);
+    brelse(bf);
+}
+
+// 对 count 个已被当前任务加锁的缓存提交异步设备请求，不等待请求完成，请求完成后缓存自动解锁
+// 缓存按照设备号和块号排列时，同一设备上块号连续的请求在蓄流期间合并为一次设备操作，
+// 不同设备 (例如不同 ATA 总线上的磁盘) 的请求则同时进行
+static void buffer_submit(buffer_t **bufs, size_t count, req_type_t type) {
+    devid_t plugged = EOF;
+
+    for (size_t i = 0; i < count; i++) {
+        buffer_t *bf = bufs[i];
+        assert(bf->state & BUF_LOCKED);
+
+        if (bf->dev_id != plugged) {
+            if (plugged != EOF) {
+                dev_unplug(plugged);
+            }
+            plugged = bf->dev_id;
+            dev_plug(plugged);
+        }
+
+        // 写请求先清除脏位，如果写回期间缓存被再次修改，会重新加入脏链表，等待下一次写回
+        if (type == REQ_WRITE) {
+            assert(bf->state & BUF_UPTODATE);
+            bclean(bf);
+        }
+
+        // I/O 期间持有缓存的引用，防止缓存被回收
+        bf->state |= BUF_IO;
+        bf->count++;
+        submit_request(bf->dev_id, bf->data, BLOCK_SECS, bf->block * BLOCK_SECS, 0, type, buffer_end_io, bf);
+    }
+
+    if (plugged != EOF) {
+        dev_unplug(plugged);
+    }
+}
+
+// 读取设备号 dev_id 的第 block 块数据到高速缓存，读取失败时释放缓存并返回 NULL
 buffer_t *bread(devid_t dev_id, size_t block) {
     buffer_t *bf = getblk(dev_id, block);
     assert(bf != NULL);
 
     // 如果缓存有效，直接返回
-    if (bf->valid) {
+    if (bf->state & BUF_UPTODATE) {
         return bf;
     }
 
-    // 否则请求读取对应的数据，并设置相应标识
-    dev_request(bf->dev_id, bf->data, BLOCK_SECS, bf->block * BLOCK_SECS, 0, REQ_READ);
-    bf->dirty = false;
-    bf->valid = true;
+    // 否则加锁后请求读取对应的数据，如果其它任务正在读取该块，则会等待其完成
+    // 等待结束后缓存可能已经有效，此时无需重复读取
+    buffer_lock(bf);
+    if (bf->state & BUF_UPTODATE) {
+        buffer_unlock(bf);
+        return bf;
+    }
 
+    // 请求完成后缓存自动解锁，失败时缓存处于错误状态且仍然无效
+    buffer_submit(&bf, 1, REQ_READ);
+    buffer_wait(bf);
+
+    if (!(bf->state & BUF_UPTODATE)) {
+        LOGK("bread device %d block %d failed\n", dev_id, block);
+        brelse(bf);
+        return NULL;
+    }
     return bf;
 }
 
+// 异步预读设备号 dev_id 的第 block 块数据到高速缓存
+void bprefetch(devid_t dev_id, size_t block) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+
+    // 已经在高速缓存中，无需预读
+    if (hash_lookup(dev_id, block)) {
+        return;
+    }
+
+    // 预读队列已满，直接放弃本次预读
+    if (ra_tail - ra_head == READAHEAD_NR) {
+        return;
+    }
+
+    readahead_t *ra = &ra_queue[ra_tail % READAHEAD_NR];
+    ra->dev_id = dev_id;
+    ra->block = block;
+    ra_tail++;
+
+    // 唤醒等待请求的预读线程
+    if (ra_idle) {
+        ra_idle = false;
+        task_unblock(ra_task);
+    }
+}
+
+// 读取设备号 dev_id 的第 block 块数据到高速缓存，并异步预读 ahead 数组中的 count 个块，读取失败返回 NULL
+buffer_t *breada(devid_t dev_id, size_t block, size_t *ahead, size_t count) {
+    buffer_t *bf = bread(dev_id, block);
+    for (size_t i = 0; i < count; i++) {
+        bprefetch(dev_id, ahead[i]);
+    }
+    return bf;
+}
+
+// 将高速缓存 bf 标记为脏，由回写线程延迟写回
+void bdirty(buffer_t *bf) {
+    assert(bf != NULL);
+
+    // 已经为脏，则无需处理，这样多次修改同一块只需一次写回
+    if (bf->state & BUF_DIRTY) {
+        return;
+    }
+
+    bf->state |= BUF_DIRTY;
+    bf->dirty_time = jiffies;
+    list_push_back(&dirty_list, &bf->dnode);
+    dirty_cnt++;
+
+    // 如果脏缓存占比过高，则立即唤醒回写线程
+    if (flush_task && flush_task->state == TASK_SLEEPING 
+        && dirty_cnt >= FLUSH_BATCH && dirty_cnt * 100 > buff_cnt * FLUSH_RATIO) {
+        task_unblock(flush_task);
+    }
+}
+
 // 将高速缓存 bf 的数据写回设备对应区域
 void bwrite(buffer_t *bf) {
     assert(bf != NULL);
 
     // 如果缓存不为脏，则直接返回
-    if (!bf->dirty) {
+    if (!(bf->state & BUF_DIRTY)) {
+        return;
+    }
+
+    // 否则加锁后请求写入对应的数据，加锁期间可能已被其它任务写回
+    buffer_lock(bf);
+    if (!(bf->state & BUF_DIRTY)) {
+        buffer_unlock(bf);
         return;
     }
 
-    // 否则请求写入对应的数据，并设置相应标识
-    dev_request(bf->dev_id, bf->data, BLOCK_SECS, bf->block * BLOCK_SECS, 0, REQ_WRITE);
-    bf->dirty = false;
-    bf->valid = true;
+    // 请求完成后缓存自动解锁
+    buffer_submit(&bf, 1, REQ_WRITE);
+    buffer_wait(bf);
+}
+
+// 读取设备号 dev_id 从第 start 块开始的连续 count 块数据到高速缓存
+// 其中连续的无效缓存会合并为一次多扇区的设备请求，bufs 为 NULL 时不等待读取完成，直接释放缓存
+// 读取失败的块释放缓存并在 bufs 中置为 NULL，此时返回 EOF
+i32 bread_cluster(devid_t dev_id, size_t start, size_t count, buffer_t **bufs) {
+    buffer_t *cluster[CLUSTER_MAX];
+    buffer_t *reads[CLUSTER_MAX];
+    i32 ret = 0;
+
+    for (size_t done = 0; done < count;) {
+        size_t n = MIN(count - done, CLUSTER_MAX);
+
+        for (size_t i = 0; i < n; i++) {
+            cluster[i] = getblk(dev_id, start + done + i);
+        }
+
+        // 对无效且未被加锁的缓存加锁，已被加锁的缓存表示其它任务的 I/O 正在进行
+        size_t nr = 0;
+        for (size_t i = 0; i < n; i++) {
+            buffer_t *bf = cluster[i];
+            if (!(bf->state & BUF_UPTODATE) && buffer_trylock(bf)) {
+                reads[nr++] = bf;
+            }
+        }
+
+        // 块号连续的读请求由设备层合并读取
+        buffer_submit(reads, nr, REQ_READ);
+
+        for (size_t i = 0; i < n; i++) {
+            if (bufs) {
+                // 等待对该缓存的 I/O 完成
+                buffer_wait(cluster[i]);
+                bufs[done + i] = cluster[i];
+                if (!(cluster[i]->state & BUF_UPTODATE)) {
+                    brelse(cluster[i]);
+                    bufs[done + i] = NULL;
+                    ret = EOF;
+                }
+            } else {
+                brelse(cluster[i]);
+            }
+        }
+        done += n;
+    }
+    return ret;
 }
 
 // 释放高速缓存 bf
@@ -183,18 +773,12 @@ void brelse(buffer_t *bf) {
     if (bf->count > 0) {
         return;
     }
-    // 否则加入空闲链表
-    ASSERT_NODE_FREE(&bf->rnode);
-    list_push_front(&free_list, &bf->rnode);
-
-    // 如果缓存为脏，则先进行写回
-    if (bf->dirty) {
-        bwrite(bf);
-    }
+    // 否则加入空闲链表 (已由 free 标志保证不在链表中，无需遍历检查)
+    free_list_insert(bf);
 
     // 如果空闲链表不为空，即有等待缓存的任务，则进行唤醒
     if (!list_empty(&wait_list)) {
-        task_t *task = element_entry(task_t, node, list_pop_front(&wait_list));
+        task_t *task = element_entry(task_t, node, wait_list.head.next);
         task_unblock(task);
     }
 }
@@ -204,11 +788,202 @@ void buffer_init() {
     LOGK("buffer_t size if %d\n", sizeof(buffer_t));
 
     // 初始化空闲链表
+#if BUFFER_POLICY == POLICY_2Q
+    list_init(&a1_list);
+    list_init(&am_list);
+    a1_cnt = 0;
+
+    // 初始化影子队列
+    ghosts = (ghost_t *)kalloc_page(GHOST_PAGES);
+    for (size_t i = 0; i < GHOST_NR; i++) {
+        ghosts[i].dev_id = EOF;
+        ghosts[i].hnode.prev = ghosts[i].hnode.next = NULL;
+    }
+    ghost_next = 0;
+    ghost_table = hash_alloc(GHOST_BITS);
+#else
     list_init(&free_list);
+#endif
+    memset(&stat, 0, sizeof(stat));
+    // 初始化备用链表
+    list_init(&spare_list);
     // 初始化等待链表
     list_init(&wait_list);
+    // 初始化脏链表
+    list_init(&dirty_list);
+    dirty_cnt = 0;
+    // 初始化预读队列
+    ra_head = ra_tail = 0;
+    ra_task = NULL;
+    ra_idle = false;
     // 初始化哈希表
-    for (size_t i = 0; i < HASH_COUNT; i++) {
-        list_init(&hash_table[i]);
+    hash_bits = HASH_MIN_BITS;
+    hash_table = hash_alloc(hash_bits);
+    // 内核空闲页不足时回收高速缓存
+    register_shrinker(buffer_shrink);
+}
+
+// 按照设备号和块号对缓存数组进行插入排序，使得写回请求按照 LBA 顺序进入电梯调度
+static void sort_buffers(buffer_t **bufs, size_t count) {
+    for (size_t i = 1; i < count; i++) {
+        buffer_t *bf = bufs[i];
+        size_t j = i;
+        for (; j > 0; j--) {
+            buffer_t *prev = bufs[j - 1];
+            if (prev->dev_id < bf->dev_id) break;
+            if (prev->dev_id == bf->dev_id && prev->block <= bf->block) break;
+            bufs[j] = prev;
+        }
+        bufs[j] = bf;
+    }
+}
+
+// 写回一批脏缓存，all 为 false 时只写回超过驻留时间的缓存 (脏缓存占比过高时除外)
+// all 为 true 时跳过在 since 之后写回失败又重新变脏的缓存，避免设备持续出错时无限重试
+// 返回提交写回以及等待解锁的缓存数量，为 0 表示本批没有任何进展，调用者不应继续循环
+static size_t flush_batch(bool all, u32 since) {
+    buffer_t *bufs[FLUSH_BATCH];
+    size_t count = 0;
+
+    bool over = dirty_cnt * 100 > buff_cnt * FLUSH_RATIO;
+    u32 expire = div_round_up(FLUSH_EXPIRE, jiffy);
+
+    // 脏链表按照变脏的时间先后排列，从头部开始收集
+    list_node_t *node = dirty_list.head.next;
+    while (node != &dirty_list.tail && count < FLUSH_BATCH) {
+        buffer_t *bf = element_entry(buffer_t, dnode, node);
+        if (!all && !over && jiffies - bf->dirty_time < expire) {
+            break;
+        }
+        node = node->next;
+        if (all && (bf->state & BUF_ERROR) && bf->dirty_time >= since) {
+            continue;
+        }
+
+        // 增加引用计数，防止写回期间缓存被回收
+        free_list_remove(bf);
+        bf->count++;
+        bufs[count++] = bf;
+    }
+
+    sort_buffers(bufs, count);
+
+    // 对仍为脏的缓存加锁，已被加锁的缓存表示其它任务正在对其进行 I/O
+    // 写回全部缓存时需要等待这些缓存解锁，之后由下一批写回，否则跳过即可
+    buffer_t *writes[FLUSH_BATCH];
+    buffer_t *busy[FLUSH_BATCH];
+    size_t nr = 0;
+    size_t waits = 0;
+    for (size_t i = 0; i < count; i++) {
+        buffer_t *bf = bufs[i];
+        if (!(bf->state & BUF_DIRTY)) continue;
+        if (buffer_trylock(bf)) {
+            writes[nr++] = bf;
+        } else if (all) {
+            busy[waits++] = bf;
+        }
+    }
+
+    // 同一设备上块号连续的写请求合并为一次设备操作，不同设备上的写请求同时进行
+    buffer_submit(writes, nr, REQ_WRITE);
+    for (size_t i = 0; i < nr; i++) {
+        buffer_wait(writes[i]);
+    }
+    for (size_t i = 0; i < waits; i++) {
+        buffer_wait(busy[i]);
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        brelse(bufs[i]);
+    }
+    return nr + waits;
+}
+
+// 将所有脏的高速缓存写回设备，之前写回失败的缓存会重试一次，仍有缓存写回失败时返回 EOF
+i32 bsync() {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+    u32 since = jiffies;
+    while (flush_batch(true, since) > 0)
+        ;
+
+    list_node_t *node;
+    for (node = dirty_list.head.next; node != &dirty_list.tail; node = node->next) {
+        buffer_t *bf = element_entry(buffer_t, dnode, node);
+        if (bf->state & BUF_ERROR) {
+            return EOF;
+        }
+    }
+    return 0;
+}
+
+// 高速缓存回写线程 flush
+void flush_thread() {
+    irq_enable();
+
+    flush_task = current_task();
+    while (true) {
+        sleep(FLUSH_INTERVAL);
+
+        u32 irq = irq_disable();
+        while (flush_batch(false, 0) == FLUSH_BATCH)
+            ;
+        set_irq_state(irq);
+    }
+}
+
+// 高速缓存预读线程 readahead
+void readahead_thread() {
+    irq_enable();
+
+    ra_task = current_task();
+    while (true) {
+        u32 irq = irq_disable();
+
+        if (ra_head == ra_tail) {
+            // 没有预读请求，阻塞等待 bprefetch() 唤醒
+            ra_idle = true;
+            task_block(ra_task, NULL, TASK_BLOCKED);
+        } else {
+            readahead_t *ra = &ra_queue[ra_head % READAHEAD_NR];
+            devid_t dev_id = ra->dev_id;
+            size_t block = ra->block;
+            size_t count = 1;
+            ra_head++;
+
+            // 将队列中紧随其后的连续块合并为一次读取
+            while (ra_head != ra_tail && count < CLUSTER_MAX) {
+                ra = &ra_queue[ra_head % READAHEAD_NR];
+                if (ra->dev_id != dev_id || ra->block != block + count) break;
+                count++;
+                ra_head++;
+            }
+
+            bread_cluster(dev_id, block, count, NULL);
+        }
+
+        set_irq_state(irq);
+    }
+}
+
+// 获取高速缓存统计信息
+void buffer_stat(buffer_stat_t *info) {
+    memcpy(info, &stat, sizeof(buffer_stat_t));
+    info->buffers = buff_cnt;
+    info->dirty = dirty_cnt;
+}
+
+/*******************************
+ ***     实现的系统调用处理     ***
+ *******************************/
+
+i32 sys_sync() {
+    return bsync();
+}
+
+i32 sys_bufstat(buffer_stat_t *info) {
+    if (info == NULL) {
+        return EOF;
     }
+    buffer_stat(info);
+    return 0;
 }
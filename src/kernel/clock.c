@@ -3,12 +3,17 @@
 #include <xos/assert.h>
 #include <xos/debug.h>
 #include <xos/task.h>
+#include <xos/ata.h>
 
 // 对应计数器相关的端口
 #define PIT_CHAN0_PORT 0x40
 #define PIT_CHAN2_PORT 0x42
 #define PIT_CTRL_PORT  0x43
 
+// 中断控制器主片的控制端口，以及读取中断请求寄存器的命令
+#define PIC_M_CTRL   0x20
+#define PIC_READ_IRR 0x0a
+
 // PC Speaker 对应的端口
 #define PC_SPEAKER_PORT 0x61
 
@@ -56,6 +61,9 @@ void clock_handler(int vector) {
     // 唤醒睡眠结束的任务
     task_wakeup();
 
+    // 检测等待驱动器就绪的磁盘总线
+    ata_clock();
+
     // 更新时间片计数
     jiffies++;
     // DEBUGK("clock jiffies %d ...\n", jiffies);
@@ -72,6 +80,25 @@ void clock_handler(int vector) {
     }
 }
 
+// 获取系统启动以来的微秒数 (约 71 分钟回绕)，用于测量较短的时间间隔
+// 时间片内的时间由计数器 0 的当前计数得到，计数器已重新装载但时钟中断尚未处理时补上一个时间片
+u32 clock_us() {
+    u32 irq = irq_disable();
+
+    outb(PIT_CTRL_PORT, 0); // 锁存计数器 0 的当前计数
+    u32 count = inb(PIT_CHAN0_PORT);
+    count |= inb(PIT_CHAN0_PORT) << 8;
+
+    u32 ticks = jiffies;
+    outb(PIC_M_CTRL, PIC_READ_IRR);
+    if ((inb(PIC_M_CTRL) & 1) && count > CLOCK_COUNTER / 2) {
+        ticks++;
+    }
+
+    set_irq_state(irq);
+    return ticks * jiffy * 1000 + (CLOCK_COUNTER - count) * 1000 / (OSCILLATOR / 1000);
+}
+
 void pit_init() {
     // 配置计数器 0 时钟
     outb(PIT_CTRL_PORT, 0b00110100);
@@ -4,8 +4,9 @@
 #include <xos/assert.h>
 #include <xos/debug.h>
 #include <xos/interrupt.h>
-
-#define DEV_NR 64 // 设备数量
+#include <xos/stdlib.h>
+#include <xos/iosched.h>
+#include <xos/time.h>
 
 // 设备数组
 static dev_t devices[DEV_NR];
@@ -29,11 +30,23 @@ devid_t dev_install(dev_type_t type, dev_subtype_t subtype, void *dev, char *nam
     strncpy(vdev->name, name, DEV_NAMELEN);
     vdev->type = type;
     vdev->subtype = subtype;
-    vdev->parent = -1;
+    vdev->parent = parent;
     vdev->dev = dev;
     vdev->ioctl = ioctl;
     vdev->read = read;
     vdev->write = write;
+    vdev->request = NULL;
+
+    // 块设备预先分配固定数量的请求，避免每次请求都经过内存分配
+    // 默认按提交顺序执行请求：内存、虚拟和堆叠设备没有寻道开销，NCQ 和 virtio 设备由设备或宿主机自行排序
+    // 有寻道开销的旋转磁盘由驱动在安装后通过 DEV_CMD_SCHEDULER 选择调度算法
+    if (type == DEV_BLOCK) {
+        vdev->sched = iosched_get(IOSCHED_NOOP);
+        vdev->requests = (request_t *)kmalloc(sizeof(request_t) * DEV_REQUEST_NR);
+        for (size_t i = 0; i < DEV_REQUEST_NR; i++) {
+            list_push_back(&vdev->free_requests, &vdev->requests[i].node);
+        }
+    }
 
     return vdev->dev_id;
 }
@@ -51,6 +64,17 @@ dev_t *dev_find(dev_subtype_t subtype, size_t idx) {
     return NULL;
 }
 
+// 根据设备名查找设备，没有则返回 NULL
+dev_t *dev_find_name(char *name) {
+    for (size_t i = 0; i < DEV_NR; i++) {
+        dev_t *dev = &devices[i];
+        if (dev->type != DEV_NULL && !strcmp(dev->name, name)) {
+            return dev;
+        }
+    }
+    return NULL;
+}
+
 // 根据设备号查找设备
 dev_t *dev_get(devid_t dev_id) {
     assert(dev_id >= 0 && dev_id < DEV_NR);
@@ -59,10 +83,37 @@ dev_t *dev_get(devid_t dev_id) {
     return dev;
 }
 
+// 设置块设备 dev 的 I/O 调度算法，只能在设备没有请求时修改
+static i32 dev_set_scheduler(dev_t *dev, iosched_type_t type) {
+    iosched_t *sched = iosched_get(type);
+    if (dev->type != DEV_BLOCK || sched == NULL || !list_empty(&dev->request_list)) {
+        return EOF;
+    }
+    dev->sched = sched;
+    LOGK("Device %d use I/O scheduler %s\n", dev->dev_id, sched->name);
+    return 0;
+}
+
+// 设置块设备 dev 同时执行的最大请求数 (例如支持命令队列的磁盘)，只能在设备没有请求时修改
+static i32 dev_set_depth(dev_t *dev, size_t depth) {
+    if (dev->type != DEV_BLOCK || depth == 0 || depth > DEV_REQUEST_NR || !list_empty(&dev->request_list)) {
+        return EOF;
+    }
+    dev->depth = depth;
+    LOGK("Device %d queue depth %d\n", dev->dev_id, depth);
+    return 0;
+}
+
 // 控制设备
 i32 dev_ioctl(devid_t dev_id, dev_cmd_t cmd, void *args, i32 flags) {
     ASSERT_IRQ_DISABLE();   // 保证中断禁止
     dev_t *dev = dev_get(dev_id);
+    if (cmd == DEV_CMD_SCHEDULER) {
+        return dev_set_scheduler(dev, (iosched_type_t)args);
+    }
+    if (cmd == DEV_CMD_QUEUE_DEPTH) {
+        return dev_set_depth(dev, (size_t)args);
+    }
     if (dev->ioctl == NULL) {
         LOGK("Device %d's ioctl is unimplement...\n", dev->dev_id);
         return EOF;
@@ -92,65 +143,245 @@ i32 dev_write(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags) {
     return dev->write(dev->dev, buf, count, idx, flags);
 }
 
-// 使用电梯调度算法 (SCAN) 获取所给磁盘请求 req 的下一个请求
-static request_t *next_request(dev_t *dev, request_t *req) {
+// 获取设备 dev 的请求队列所在的设备，没有请求队列的分区设备使用父设备 (磁盘) 的请求队列
+static dev_t *queue_dev(dev_t *dev) {
+    if (dev->request == NULL && dev->parent >= 0) {
+        return dev_get(dev->parent);
+    }
+    return dev;
+}
+
+static void queue_unplug(dev_t *dev);
+
+// 从设备 dev 的请求池中获取空闲请求，如果请求已耗尽，则阻塞等待直到有请求被释放
+static request_t *get_request(dev_t *dev) {
+    while (list_empty(&dev->free_requests)) {
+        // 蓄流中的请求必须开始执行，才会有请求被释放
+        queue_unplug(dev);
+        task_block(current_task(), &dev->request_waiters, TASK_BLOCKED);
+    }
+    return element_entry(request_t, node, list_pop_front(&dev->free_requests));
+}
+
+// 将请求 req 归还到设备 dev 的请求池，并唤醒一个等待空闲请求的任务
+static void put_request(dev_t *dev, request_t *req) {
+    list_insert_after(&dev->free_requests.head, &req->node);
+
+    if (!list_empty(&dev->request_waiters)) {
+        task_t *task = element_entry(task_t, node, dev->request_waiters.head.next);
+        assert(task->magic == XOS_MAGIC); // 检测栈溢出
+        task_unblock(task);
+    }
+}
+
+// 尝试将请求 req 与请求列表中 LBA 相邻的同类型请求合并，成功返回 true
+// 合并后的请求作为一次设备操作执行，正在执行的请求不能再合并
+static bool merge_request(dev_t *dev, request_t *req) {
+    i32 max = dev_ioctl(dev->dev_id, DEV_CMD_SECTOR_MAX, NULL, 0);
+    if (max <= 0) {
+        return false;
+    }
+    size_t limit = MIN((size_t)max, DEV_MERGE_MAX);
+
     list_t *list = &dev->request_list;
+    for (list_node_t *node = list->head.next; node != &list->tail; node = node->next) {
+        request_t *ptr = element_entry(request_t, node, node);
+        if (ptr->started || ptr->type != req->type || ptr->flags != req->flags) {
+            continue;
+        }
+        if (ptr->total + req->count > limit) {
+            continue;
+        }
 
-    // 如果磁盘在当前寻道方向上没有待处理的请求，则变换寻道方向
-    // 磁盘设备请求列表按照请求的 LBA 进行排序，即正向为向内寻道，反向为外里寻道
-    if (dev->direction == DIRECT_OUT && list_istail(list, &req->node)) {
-        dev->direction = DIRECT_IN;
-    } else if (dev->direction ==  DIRECT_IN && list_ishead(list, &req->node)) {
-        dev->direction = DIRECT_OUT;
+        // 向后合并，req 接在 ptr 的合并链表尾部
+        if (ptr->idx + ptr->total == req->idx) {
+            request_t *tail = ptr;
+            while (tail->next) {
+                tail = tail->next;
+            }
+            tail->next = req;
+            ptr->total += req->count;
+            LOGK("Device %d back merge index %d to %d\n", dev->dev_id, req->idx, ptr->idx);
+            return true;
+        }
+
+        // 向前合并，req 取代 ptr 在调度队列中的位置，成为合并后的首个请求
+        if (req->idx + req->count == ptr->idx) {
+            dev->sched->replace(dev, ptr, req);
+            req->next = ptr;
+            req->total = req->count + ptr->total;
+            LOGK("Device %d front merge index %d to %d\n", dev->dev_id, req->idx, ptr->idx);
+            return true;
+        }
     }
+    return false;
+}
 
-    // 根据寻道方向获取下一个请求
-    list_node_t *next = NULL;
-    switch (dev->direction) {
-    case DIRECT_OUT:
-        next = req->node.next;
-        break;
-    case DIRECT_IN:
-        next = req->node.prev;
-        break;
-    default:
-        panic("Unknown device direction...\n");
-        break;
+// 获取合并后的请求 req 中第 sector 个扇区对应的缓冲区
+void *request_buffer(request_t *req, size_t sector) {
+    assert(sector < req->total);
+    request_t *ptr = req;
+    while (sector >= ptr->count) {
+        sector -= ptr->count;
+        ptr = ptr->next;
     }
+    return ptr->buf + sector * SECTOR_SIZE;
+}
 
-    // 如果没有其它请求则返回 NULL
-    if (list_singular(list)) {
-        return NULL;
+// 从时刻 since 到 now 经过的微秒数，时钟误差导致时间倒退时视为 0
+static u32 elapsed_us(u32 since, u32 now) {
+    return (i32)(now - since) < 0 ? 0 : now - since;
+}
+
+// 将 us 微秒的延迟计入 log2 直方图 hist
+static void hist_add(u32 *hist, u32 us) {
+    size_t idx = 0;
+    while ((us >>= 1) && idx < DEV_HIST_NR - 1) {
+        idx++;
+    }
+    hist[idx]++;
+}
+
+// 累计设备 dev 的忙碌时间
+static void dev_busy(dev_t *dev, u32 us) {
+    dev->busy_us += us;
+    dev->stat.busy += dev->busy_us / 1000;
+    dev->busy_us %= 1000;
+}
+
+// 请求 req 在时刻 now 结束，记录执行结果和统计信息，调用回调函数或唤醒等待请求的任务
+static void request_finish(dev_t *dev, request_t *req, i32 ret, u32 now) {
+    dev_stat_t *stat = &dev->stat;
+    stat->queued--;
+    stat->ios[req->type]++;
+    if (ret < 0) {
+        stat->errors++;
+    } else {
+        stat->sectors[req->type] += req->count;
+    }
+    hist_add(stat->latency, elapsed_us(req->submit_time, now));
+    hist_add(stat->service, elapsed_us(req->start_time, now));
+
+    req->ret = ret;
+    req->done = true;
+
+    if (req->callback) {
+        req->callback(req);
+        put_request(dev, req);
+    } else if (req->task) {
+        assert(req->task->magic == XOS_MAGIC); // 检测栈溢出
+        task_unblock(req->task);
     }
+}
+
+// 设备 dev 开始执行请求 req，如果设备立即返回失败，则直接结束该请求
+static void dev_dispatch(dev_t *dev, request_t *req) {
+    LOGK("Device %d dispatch request index %d count %d\n", dev->dev_id, req->idx, req->total);
+    req->started = true;
 
-    return element_entry(request_t, node, next);
+    // 合并的请求同时开始执行
+    u32 now = clock_us();
+    for (request_t *ptr = req; ptr; ptr = ptr->next) {
+        ptr->start_time = now;
+    }
+    if (dev->inflight++ == 0) {
+        dev->busy_since = now;
+    }
+    if (dev->request(dev->dev, req) < 0) {
+        request_complete(req, EOF);
+    }
 }
 
-// 块设备执行请求
-static void do_dev_request(request_t *req) {
+// 获取设备 dev 的请求列表中第一个尚未开始执行的请求，没有则返回 NULL
+static request_t *waiting_request(dev_t *dev) {
+    list_t *list = &dev->request_list;
+    for (list_node_t *node = list->head.next; node != &list->tail; node = node->next) {
+        request_t *req = element_entry(request_t, node, node);
+        if (!req->started) {
+            return req;
+        }
+    }
+    return NULL;
+}
+
+// 在设备 dev 同时执行的请求数未达上限时开始执行请求，优先执行 next
+// next 为 NULL 或者已经开始执行时，按照请求列表的顺序选择尚未开始执行的请求
+static void queue_run(dev_t *dev, request_t *next) {
+    while (dev->inflight < dev->depth) {
+        if (next == NULL || next->started) {
+            next = waiting_request(dev);
+        }
+        if (next == NULL) {
+            return;
+        }
+        request_t *req = next;
+        next = NULL;
+        dev_dispatch(dev, req);
+    }
+}
+
+// 设备完成请求 req 后调用 (通常位于中断处理中)，ret 为执行结果
+// 将结果分发给合并的每个请求，并由 I/O 调度器选择下一个请求开始执行
+// 同时执行多个请求的设备由设备自身 (例如磁盘的命令队列) 决定执行顺序，按照请求列表的顺序补充请求
+void request_complete(request_t *req, i32 ret) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+
+    dev_t *dev = dev_get(req->dev_id);
+    assert(req->started && dev->inflight > 0);
+
+    request_t *next = dev->depth == 1 ? dev->sched->next(dev, req) : NULL;
+    dev->sched->remove(dev, req);
+
+    u32 now = clock_us();
+    if (--dev->inflight == 0) {
+        dev_busy(dev, elapsed_us(dev->busy_since, now));
+    }
+
+    // 回调函数可能释放请求，所以需要先获取合并链表的下一个请求
+    for (request_t *ptr = req; ptr;) {
+        request_t *merged = ptr->next;
+        request_finish(dev, ptr, ret, now);
+        ptr = merged;
+    }
+
+    // 完成请求的过程中可能已经有新的请求开始执行
+    queue_run(dev, next);
+}
+
+// 块设备执行同步请求
+static i32 do_dev_request(request_t *req) {
     LOGK("Device %d do request index %d\n", req->dev_id, req->idx);
 
     switch (req->type) {
     case REQ_READ:
-        dev_read(req->dev_id, req->buf, req->count, req->idx, req->flags);
-        break;
+        return dev_read(req->dev_id, req->buf, req->count, req->idx, req->flags);
     case REQ_WRITE:
-        dev_write(req->dev_id, req->buf, req->count, req->idx, req->flags);
-        break;
+        return dev_write(req->dev_id, req->buf, req->count, req->idx, req->flags);
     default:
         panic("Unknown request type %d...");
         break;
     }
 }
 
-// 块设备请求
-void dev_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags, req_type_t type) {
+// 提交块设备请求，wait 为 false 时如果请求池已耗尽则不阻塞，直接返回 NULL
+static request_t *do_submit_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags, 
+                                    req_type_t type, void (*callback)(request_t *req), void *data, bool wait) {
     ASSERT_IRQ_DISABLE();   // 保证中断禁止
 
     dev_t *dev = dev_get(dev_id);   // 获取设备
     assert(dev->type == DEV_BLOCK); // 保证为块设备
 
-    request_t *req = (request_t *)kmalloc(sizeof(request_t));
+    // 没有请求队列的分区设备，将请求转换为对父设备 (磁盘) 的请求
+    if (dev->request == NULL && dev->parent >= 0) {
+        idx += dev_ioctl(dev_id, DEV_CMD_SECTOR_START, NULL, 0);
+        dev = dev_get(dev->parent);
+        dev_id = dev->dev_id;
+    }
+
+    if (!wait && list_empty(&dev->free_requests)) {
+        return NULL;
+    }
+    request_t *req = get_request(dev);
 
     req->dev_id = dev_id;
     req->type = type;
@@ -158,31 +389,122 @@ void dev_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags,
     req->count = count;
     req->flags = flags;
     req->buf = buf;
-    req->task = current_task();
+    req->task = NULL;
+    req->started = false;
+    req->next = NULL;
+    req->total = count;
+    req->done = false;
+    req->ret = 0;
+    req->callback = callback;
+    req->data = data;
+    req->submit_time = clock_us();
+    req->start_time = req->submit_time;
+
+    if (++dev->stat.queued > dev->stat.max_queued) {
+        dev->stat.max_queued = dev->stat.queued;
+    }
+
+    LOGK("Device %d submit request index %d\n", req->dev_id, req->idx);
+
+    // 不支持异步请求的设备，直接同步执行请求
+    if (dev->request == NULL) {
+        i32 ret = do_dev_request(req);
+        u32 now = clock_us();
+        dev_busy(dev, elapsed_us(req->start_time, now));
+        request_finish(dev, req, ret, now);
+        return req;
+    }
+
+    // 优先与相邻的请求合并，否则由 I/O 调度器将请求加入对应设备的请求列表
+    // 如果设备空闲且没有蓄流，则直接开始执行请求
+    if (merge_request(dev, req)) {
+        dev->stat.merges[type]++;
+    } else {
+        dev->sched->add(dev, req);
+        if (!dev->plugged) {
+            queue_run(dev, req);
+        }
+    }
+    return req;
+}
+
+// 提交块设备请求，不等待请求完成，返回请求句柄
+// 如果设置了回调函数 callback，则请求完成时 (通常位于中断处理中) 调用，之后请求自动释放，返回的句柄不再有效
+// 否则需要调用 wait_request() 等待请求完成并释放请求
+request_t *submit_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags, 
+                          req_type_t type, void (*callback)(request_t *req), void *data) {
+    return do_submit_request(dev_id, buf, count, idx, flags, type, callback, data, true);
+}
+
+// 与 submit_request() 相同，但是设备的请求池已耗尽时不阻塞，直接返回 NULL，可以在中断处理中调用
+request_t *try_submit_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags, 
+                              req_type_t type, void (*callback)(request_t *req), void *data) {
+    return do_submit_request(dev_id, buf, count, idx, flags, type, callback, data, false);
+}
+
+// 设备蓄流，之后提交的请求暂不执行，以便与随后提交的相邻请求合并为一次设备操作
+void dev_plug(devid_t dev_id) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+    dev_t *dev = queue_dev(dev_get(dev_id));
+    if (dev->request) {
+        dev->plugged = true;
+    }
+}
+
+// 解除设备 dev 的蓄流，如果设备空闲，则开始执行请求列表中的请求
+static void queue_unplug(dev_t *dev) {
+    if (!dev->plugged) {
+        return;
+    }
+    dev->plugged = false;
+    queue_run(dev, NULL);
+}
+
+// 解除设备蓄流，开始执行蓄流期间提交的请求
+void dev_unplug(devid_t dev_id) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+    queue_unplug(queue_dev(dev_get(dev_id)));
+}
 
-    LOGK("Device %d request index %d\n", req->dev_id, req->idx);
+// 等待请求 req 完成并释放请求，成功返回 0，失败返回 EOF
+i32 wait_request(request_t *req) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+    assert(req->callback == NULL);
 
-    // 将请求加入对应设备的请求列表，如果设备的请求列表有其它请求，则阻塞等待调度
-    // 否则直接执行请求，无需阻塞
-    // 使用插入排序算法，按照 LBA 的大小进行排序
-    bool flag = list_empty(&dev->request_list);
-    // list_push_back(&dev->request_list, &req->node);
-    list_insert_sort(&dev->request_list, &req->node, list_node_offset(request_t, node, idx));
-    if (!flag) {
+    while (!req->done) {
+        req->task = current_task();
         task_block(req->task, NULL, TASK_BLOCKED);
     }
 
-    // 执行对应的请求操作，并移出请求列表
-    do_dev_request(req);
-    request_t *next_req = next_request(dev, req);
-    list_remove(&req->node);
-    kfree(req);
+    i32 ret = req->ret;
+    put_request(dev_get(req->dev_id), req);
+    return ret < 0 ? EOF : 0;
+}
+
+// 块设备请求，等待请求完成后返回，成功返回 0，失败返回 EOF
+i32 dev_request(devid_t dev_id, void *buf, size_t count, size_t idx, i32 flags, req_type_t type) {
+    return wait_request(submit_request(dev_id, buf, count, idx, flags, type, NULL, NULL));
+}
 
-    // 电梯调度算法 (SCAN)
-    if (next_req != NULL) {
-        assert(next_req->task->magic == XOS_MAGIC); // 检测栈溢出
-        task_unblock(next_req->task);
+// 获取块设备 dev_id 的 I/O 统计信息，设备号无效或者不是块设备时返回 EOF
+i32 dev_stat(devid_t dev_id, dev_stat_t *stat) {
+    if (dev_id < 0 || dev_id >= DEV_NR || devices[dev_id].type != DEV_BLOCK) {
+        return EOF;
     }
+
+    u32 irq = irq_disable();
+    dev_t *dev = &devices[dev_id];
+    memcpy(stat, &dev->stat, sizeof(dev_stat_t));
+    strncpy(stat->name, dev->name, DEV_NAMELEN);
+    set_irq_state(irq);
+    return 0;
+}
+
+// 为块设备注册异步请求处理函数，设备完成请求后需要调用 request_complete()
+void dev_install_request(devid_t dev_id, void *request) {
+    dev_t *dev = dev_get(dev_id);
+    assert(dev->type == DEV_BLOCK);
+    dev->request = request;
 }
 
 // 初始化虚拟设备
@@ -199,5 +521,29 @@ void device_init() {
         dev->write = NULL;
         list_init(&dev->request_list);
         dev->direction = DIRECT_IN;
+        dev->sched = NULL;
+        list_init(&dev->fifo_list[REQ_READ]);
+        list_init(&dev->fifo_list[REQ_WRITE]);
+        dev->requests = NULL;
+        list_init(&dev->free_requests);
+        list_init(&dev->request_waiters);
+        dev->depth = 1;
+        dev->inflight = 0;
+        dev->plugged = false;
+        memset(&dev->stat, 0, sizeof(dev_stat_t));
+        dev->busy_since = 0;
+        dev->busy_us = 0;
+        dev->request = NULL;
+    }
+}
+
+/*******************************
+ ***     实现的系统调用处理     ***
+ *******************************/
+
+i32 sys_iostat(devid_t dev_id, dev_stat_t *stat) {
+    if (stat == NULL) {
+        return EOF;
     }
+    return dev_stat(dev_id, stat);
 }
@@ -68,4 +68,72 @@ outw:
     jmp $+2 ; 一些延迟
 
     leave ; 恢复栈帧
-    ret
\ No newline at end of file
+    ret
+
+global inl ; 声明 inl 为全局变量
+inl:
+    ; 保存栈帧
+    push ebp
+    mov ebp, esp
+
+    xor eax, eax       ; 清空 eax
+    mov edx, [ebp + 8] ; 参数 port
+    in eax, dx         ; 将端口号为 dx 的外设的寄存器的值输入到 eax
+
+    jmp $+2 ; 一些延迟
+    jmp $+2 ; 一些延迟
+    jmp $+2 ; 一些延迟
+
+    leave ; 恢复栈帧
+    ret
+
+global outl ; 声明 outl 为全局变量
+outl:
+    ; 保存栈帧
+    push ebp
+    mov ebp, esp
+
+    mov edx, [ebp + 8] ; 参数 port
+    mov eax, [ebp + 12]; 参数 value
+    out dx, eax        ; 将 eax 的值输出到端口号为 dx 的外设的寄存器
+
+    jmp $+2 ; 一些延迟
+    jmp $+2 ; 一些延迟
+    jmp $+2 ; 一些延迟
+
+    leave ; 恢复栈帧
+    ret
+
+global insw ; 声明 insw 为全局变量
+insw:
+    ; 保存栈帧
+    push ebp
+    mov ebp, esp
+    push edi
+
+    mov edx, [ebp + 8] ; 参数 port
+    mov edi, [ebp + 12]; 参数 buf
+    mov ecx, [ebp + 16]; 参数 count
+    cld
+    rep insw           ; 从端口号为 dx 的外设的寄存器连续输入 ecx 个字到 es:edi
+
+    pop edi
+    leave ; 恢复栈帧
+    ret
+
+global outsw ; 声明 outsw 为全局变量
+outsw:
+    ; 保存栈帧
+    push ebp
+    mov ebp, esp
+    push esi
+
+    mov edx, [ebp + 8] ; 参数 port
+    mov esi, [ebp + 12]; 参数 buf
+    mov ecx, [ebp + 16]; 参数 count
+    cld
+    rep outsw          ; 将 ds:esi 处的 ecx 个字连续输出到端口号为 dx 的外设的寄存器
+
+    pop esi
+    leave ; 恢复栈帧
+    ret
@@ -0,0 +1,166 @@
+#include <xos/iosched.h>
+#include <xos/assert.h>
+#include <xos/debug.h>
+#include <xos/stdlib.h>
+
+#define READ_EXPIRE     500     // deadline：读请求的最长等待时间 (ms)
+#define WRITE_EXPIRE    5000    // deadline：写请求的最长等待时间 (ms)
+
+extern u32 volatile jiffies;
+extern const u32 jiffy;
+
+// 获取请求列表中的节点 node 对应的请求，node 为头尾节点时返回 NULL
+static request_t *list_request(list_t *list, list_node_t *node) {
+    if (node == &list->head || node == &list->tail) {
+        return NULL;
+    }
+    return element_entry(request_t, node, node);
+}
+
+// 将请求 req 移出请求列表
+static void queue_remove(dev_t *dev, request_t *req) {
+    list_remove(&req->node);
+}
+
+// 请求 new 取代请求 old 在请求列表中的位置
+static void queue_replace(dev_t *dev, request_t *old, request_t *new) {
+    list_insert_before(&old->node, &new->node);
+    list_remove(&old->node);
+}
+
+/*******************************
+ ***  NOOP：先来先服务         ***
+ *******************************/
+
+// 请求列表按照请求到达的顺序排列
+static void noop_add(dev_t *dev, request_t *req) {
+    list_insert_before(&dev->request_list.tail, &req->node);
+}
+
+static request_t *noop_next(dev_t *dev, request_t *req) {
+    list_t *list = &dev->request_list;
+    list_node_t *node = list->head.next;
+    if (node == &req->node) {
+        node = node->next;
+    }
+    return list_request(list, node);
+}
+
+/*******************************
+ ***  SCAN：电梯调度算法       ***
+ *******************************/
+
+// 请求列表按照 LBA 排序
+static void scan_add(dev_t *dev, request_t *req) {
+    list_insert_sort(&dev->request_list, &req->node, list_node_offset(request_t, node, idx));
+}
+
+// 磁头在两个方向上来回扫描
+static request_t *scan_next(dev_t *dev, request_t *req) {
+    list_t *list = &dev->request_list;
+
+    // 如果磁盘在当前寻道方向上没有待处理的请求，则变换寻道方向
+    // 磁盘设备请求列表按照请求的 LBA 进行排序，即正向为向内寻道，反向为外里寻道
+    if (dev->direction == DIRECT_OUT && list_istail(list, &req->node)) {
+        dev->direction = DIRECT_IN;
+    } else if (dev->direction ==  DIRECT_IN && list_ishead(list, &req->node)) {
+        dev->direction = DIRECT_OUT;
+    }
+
+    // 如果没有其它请求则返回 NULL
+    if (list_singular(list)) {
+        return NULL;
+    }
+
+    // 根据寻道方向获取下一个请求
+    switch (dev->direction) {
+    case DIRECT_OUT:
+        return list_request(list, req->node.next);
+    case DIRECT_IN:
+        return list_request(list, req->node.prev);
+    default:
+        panic("Unknown device direction...\n");
+        break;
+    }
+}
+
+/*******************************
+ ***  C-SCAN：循环扫描算法     ***
+ *******************************/
+
+// 磁头只向 LBA 增大的方向扫描，到达末尾后回到最小的 LBA，每个请求的等待时间更加均匀
+static request_t *cscan_next(dev_t *dev, request_t *req) {
+    list_t *list = &dev->request_list;
+    if (list_singular(list)) {
+        return NULL;
+    }
+
+    request_t *next = list_request(list, req->node.next);
+    if (next == NULL) {
+        next = list_request(list, list->head.next);
+    }
+    return next;
+}
+
+/*******************************
+ ***  DEADLINE：截止时间调度   ***
+ *******************************/
+
+// 请求同时加入按 LBA 排序的请求列表和按截止时间排序的读/写 FIFO 列表
+static void deadline_add(dev_t *dev, request_t *req) {
+    scan_add(dev, req);
+
+    u32 expire = req->type == REQ_READ ? READ_EXPIRE : WRITE_EXPIRE;
+    req->deadline = jiffies + div_round_up(expire, jiffy);
+    list_insert_before(&dev->fifo_list[req->type].tail, &req->fnode);
+}
+
+static void deadline_remove(dev_t *dev, request_t *req) {
+    list_remove(&req->node);
+    list_remove(&req->fnode);
+}
+
+// 新的请求继承原有请求的截止时间
+static void deadline_replace(dev_t *dev, request_t *old, request_t *new) {
+    queue_replace(dev, old, new);
+    list_insert_before(&old->fnode, &new->fnode);
+    list_remove(&old->fnode);
+    new->deadline = old->deadline;
+}
+
+// 优先执行已经超时的请求 (读请求优先)，否则按照 C-SCAN 执行
+static request_t *deadline_next(dev_t *dev, request_t *req) {
+    for (size_t type = REQ_READ; type <= REQ_WRITE; type++) {
+        list_t *fifo = &dev->fifo_list[type];
+        list_node_t *node = fifo->head.next;
+        if (node == &req->fnode) {
+            node = node->next;
+        }
+        if (node == &fifo->tail) {
+            continue;
+        }
+
+        request_t *first = element_entry(request_t, fnode, node);
+        if ((i32)(jiffies - first->deadline) >= 0) {
+            LOGK("Device %d request index %d expired\n", dev->dev_id, first->idx);
+            return first;
+        }
+    }
+    return cscan_next(dev, req);
+}
+
+// I/O 调度器数组
+static iosched_t schedulers[IOSCHED_NR] = {
+    [IOSCHED_NOOP] = {"noop", noop_add, queue_remove, queue_replace, noop_next},
+    [IOSCHED_SCAN] = {"scan", scan_add, queue_remove, queue_replace, scan_next},
+    [IOSCHED_CSCAN] = {"cscan", scan_add, queue_remove, queue_replace, cscan_next},
+    [IOSCHED_DEADLINE] = {"deadline", deadline_add, deadline_remove, deadline_replace, deadline_next},
+};
+
+// 获取 type 类型的 I/O 调度器，类型无效时返回 NULL
+iosched_t *iosched_get(iosched_type_t type) {
+    if (type >= IOSCHED_NR) {
+        return NULL;
+    }
+    return &schedulers[type];
+}
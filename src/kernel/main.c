@@ -14,8 +14,15 @@ extern void keyboard_init();
 extern void tss_init();
 extern void arena_init();
 extern void ata_init();
+extern void ahci_init();
+extern void virtio_init();
+extern void ramdisk_init();
+extern void zram_init();
+extern void raid_init();
+extern void blkcache_init();
 extern void device_init();
 extern void buffer_init();
+extern void pci_init();
 extern void super_init();
 extern void inode_init();
 
@@ -32,7 +39,14 @@ void kernel_init() {
     keyboard_init();
     time_init();
     // rtc_init();
+    pci_init();
     ata_init();
+    ahci_init();
+    virtio_init();
+    ramdisk_init();
+    zram_init();
+    raid_init();
+    blkcache_init();
     buffer_init();
     task_init();
     syscall_init();
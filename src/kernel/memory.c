@@ -41,6 +41,9 @@ typedef struct memory_manager_t {
 // 内存管理器
 static memory_manager_t mm;
 
+// 启动时加载的 initrd 大小
+static u32 initrd;
+
 // 内核地址空间管理器
 typedef struct kmm_t {
     u32 kernel_page_dir;    // 内核页目录所在物理地址
@@ -48,6 +51,9 @@ typedef struct kmm_t {
     size_t kpgtbl_len;      // 内核页表地址数组的长度
     u32 kernel_space_size;  // 内核地址空间大小
     bitmap_t kernel_vmap;   // 内核虚拟内存空间位图
+    u32 free_pages;         // 内核空闲页数
+    shrinker_t shrinkers[SHRINKER_NR]; // 内存回收函数
+    size_t shrinker_cnt;    // 已注册的内存回收函数个数
 } kmm_t;
 // 内核页表索引
 static u32 KERNEL_PAGE_TABLE[] = {
@@ -64,8 +70,27 @@ static kmm_t kmm = {
     .kernel_space_size = NELEM(KERNEL_PAGE_TABLE) * 1024 * PAGE_SIZE,
 };
 
+// 将 multiboot2 模块 module 作为 initrd 拷贝到内核虚拟磁盘区域
+// 模块可能位于物理内存数组所在的位置，所以需要在初始化物理内存数组之前完成
+static void initrd_load(multiboot2_tag_module_t *module) {
+    u32 size = module->mod_end - module->mod_start;
+    if (size > KERNEL_RAMDISK_SIZE) {
+        LOGK("initrd size 0x%p larger than ramdisk, ignored\n", size);
+        return;
+    }
+    memmove((void *)KERNEL_RAMDISK_BASE, (void *)module->mod_start, size);
+    initrd = size;
+    LOGK("initrd 0x%p size 0x%p\n", module->mod_start, size);
+}
+
+// 启动时加载到内核虚拟磁盘区域的 initrd 大小，没有则为 0
+u32 get_initrd_size() {
+    return initrd;
+}
+
 void memory_init() {
     u32 cnt;
+    multiboot2_tag_module_t *module = NULL;
 
     if (magic == XOS_MAGIC) {
         // 如果是 XOS bootloader 进入的内核
@@ -90,23 +115,26 @@ void memory_init() {
 
         LOGK("Multiboot2 Information Size: 0x%p\n", total_size);
 
-        // 寻找类型为 mmap 的 tag
+        // 寻找类型为 mmap 的 tag，以及第一个模块 (作为 initrd)
+        multiboot2_tag_mmap_t *mmap_tag = NULL;
         while (tag->type != MULTIBOOT2_TAG_TYPE_END) {
-            if (tag->type == MULTIBOOT2_TAG_TYPE_END) {
-                // 如果到最后都没有找到 mmap 类型的 tag，则触发 panic 
-                panic("Memory init without mmap tag!!!\n");
-            }
             if (tag->type == MULTIBOOT2_TAG_TYPE_MMAP) {
-                break;
+                mmap_tag = (multiboot2_tag_mmap_t *)tag;
+            }
+            if (tag->type == MULTIBOOT2_TAG_TYPE_MODULE && module == NULL) {
+                module = (multiboot2_tag_module_t *)tag;
             }
             // 需要填充，使得下一个 tag 以 8 字节对齐
             tag = (multiboot2_tag_t *)(ROUND_UP((u32)tag + tag->size, 8));
         }
+        if (mmap_tag == NULL) {
+            // 如果到最后都没有找到 mmap 类型的 tag，则触发 panic 
+            panic("Memory init without mmap tag!!!\n");
+        }
 
-        multiboot2_tag_mmap_t *mmap_tag = (multiboot2_tag_mmap_t *)tag;
         multiboot2_mmap_entry_t *entry = mmap_tag->entries;
         cnt = 0;
-        while ((u32)entry < (u32)tag + tag->size) {
+        while ((u32)entry < (u32)mmap_tag + mmap_tag->size) {
             LOGK("ZONE %d:[base]0x%p,[size]:0x%p,[type]:%d\n",
                  cnt++, (u32)entry->addr, (u32)entry->len, (u32)entry->type);
             
@@ -144,6 +172,10 @@ void memory_init() {
         );
     }
 
+    if (module) {
+        initrd_load(module);
+    }
+
     // 初始化物理内存数组
     memory_map_init();
 }
@@ -295,6 +327,20 @@ static void kernel_vmap_init() {
     u8 *bits = (u8 *)KERNEL_VMAP_BITS;
     size_t size = div_round_up((PAGE_IDX(kmm.kernel_space_size) - mm.start_page_idx), 8);
     bitmap_init(&kmm.kernel_vmap, bits, size, mm.start_page_idx);
+
+    // 位图按字节对齐，超出内核地址空间的位需要标记为占用
+    for (idx_t idx = PAGE_IDX(kmm.kernel_space_size); idx < kmm.kernel_vmap.length; idx++) {
+        bitmap_insert(&kmm.kernel_vmap, idx);
+    }
+
+    // 内核虚拟磁盘区域不参与分配
+    for (idx_t idx = PAGE_IDX(KERNEL_RAMDISK_BASE); idx < PAGE_IDX(KERNEL_RAMDISK_BASE + KERNEL_RAMDISK_SIZE); idx++) {
+        bitmap_insert(&kmm.kernel_vmap, idx);
+    }
+
+    kmm.free_pages = PAGE_IDX(kmm.kernel_space_size) - mm.start_page_idx - PAGE_IDX(KERNEL_RAMDISK_SIZE);
+    kmm.shrinker_cnt = 0;
+    LOGK("Kernel free pages: %d\n", kmm.free_pages);
 }
 
 // 获取页目录
@@ -330,21 +376,7 @@ void flush_tlb(u32 vaddr) {
                  : "memory");
 }
 
-// 从位图中扫描 count 个连续的页
-static u32 scan_pages(bitmap_t *map, u32 count) {
-    assert(count > 0);
-    i32 idx = bitmap_insert_nbits(map, count);
-
-    if (idx == EOF) {
-        panic("Scan page fail!!!");
-    }
-
-    u32 addr = PAGE_ADDR(idx);
-    LOGK("Scan page 0x%p count %d\n", addr, count);
-    return addr;
-}
-
-// 与 scan_page 相对，重置相应的页
+// 在位图中重置 addr 起始的 count 个页
 static void reset_pages(bitmap_t *map, u32 addr, u32 count) {
     ASSERT_PAGE_ADDR(addr);
     assert(count > 0);
@@ -356,10 +388,46 @@ static void reset_pages(bitmap_t *map, u32 addr, u32 count) {
     }
 }
 
+// 注册内存回收函数，内核空闲页不足时会被调用
+void register_shrinker(shrinker_t shrinker) {
+    assert(kmm.shrinker_cnt < SHRINKER_NR);
+    kmm.shrinkers[kmm.shrinker_cnt++] = shrinker;
+}
+
+// 依次调用内存回收函数，尝试回收 count 个内核页，返回实际回收的页数
+static u32 shrink_pages(u32 count) {
+    u32 freed = 0;
+    for (size_t i = 0; i < kmm.shrinker_cnt && freed < count; i++) {
+        freed += kmm.shrinkers[i](count - freed);
+    }
+    LOGK("Shrink kernel pages %d/%d\n", freed, count);
+    return freed;
+}
+
+// 内核空闲页数
+u32 kernel_free_pages() {
+    return kmm.free_pages;
+}
+
 // 分配 count 个连续的内核页
 u32 kalloc_page(u32 count) {
     assert(count > 0);
-    u32 vaddr = scan_pages(&kmm.kernel_vmap, count);
+
+    // 内核空闲页低于水位线时，先回收内存 (例如高速缓存)
+    if (kmm.free_pages < count + KERNEL_PAGES_LOW) {
+        shrink_pages(count + KERNEL_PAGES_LOW - kmm.free_pages);
+    }
+
+    // 空闲页足够但不连续时，继续回收内存直到分配成功
+    i32 idx;
+    while ((idx = bitmap_insert_nbits(&kmm.kernel_vmap, count)) == EOF) {
+        if (shrink_pages(count) == 0) {
+            panic("Scan page fail!!!");
+        }
+    }
+    kmm.free_pages -= count;
+
+    u32 vaddr = PAGE_ADDR(idx);
     LOGK("ALLOC kernel pages 0x%p count %d\n", vaddr, count);
     return vaddr;
 }
@@ -369,9 +437,33 @@ void kfree_page(u32 vaddr, u32 count) {
     ASSERT_PAGE_ADDR(vaddr);
     assert(count > 0);
     reset_pages(&kmm.kernel_vmap, vaddr, count);
+    kmm.free_pages += count;
     LOGK("FREE kernel pages 0x%p count %d\n", vaddr, count);
 }
 
+// 将物理地址 paddr 开始的 size 字节设备内存 (MMIO) 映射到内核虚拟内存，返回对应的虚拟地址
+// 映射使用内核页表，内核页表由所有进程共享，所以在任何进程中都可以访问，映射后不再释放
+u32 kmap_mmio(u32 paddr, u32 size) {
+    u32 offset = paddr & 0xfff;
+    u32 count = div_round_up(offset + size, PAGE_SIZE);
+    u32 vaddr = kalloc_page(count);
+
+    for (size_t i = 0; i < count; i++) {
+        u32 page = vaddr + i * PAGE_SIZE;
+        page_entry_t *entry = &get_pte(page, false)[PTE_IDX(page)];
+
+        // 设备寄存器不能缓存，否则读取不到设备的最新状态
+        page_entry_init(entry, PAGE_IDX(paddr) + i);
+        entry->user = 0;
+        entry->pwt = 1;
+        entry->pcd = 1;
+        flush_tlb(page);
+    }
+
+    LOGK("MAP MMIO 0x%p to 0x%p count %d\n", paddr, vaddr, count);
+    return vaddr + offset;
+}
+
 // 将虚拟地址 vaddr 映射到物理内存
 void link_page(u32 vaddr) {
     ASSERT_PAGE_ADDR(vaddr); // 保证是页的起始地址
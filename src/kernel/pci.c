@@ -0,0 +1,151 @@
+#include <xos/pci.h>
+#include <xos/io.h>
+#include <xos/arena.h>
+#include <xos/assert.h>
+#include <xos/debug.h>
+
+// PCI 配置空间访问端口
+#define PCI_CONF_ADDR   0xCF8   // 地址端口
+#define PCI_CONF_DATA   0xCFC   // 数据端口
+
+#define PCI_BUS_NR  256 // 总线数量
+#define PCI_DEV_NR  32  // 每条总线的设备数量
+#define PCI_FUNC_NR 8   // 每个设备的功能数量
+
+// 配置空间地址：使能位 | 总线号 | 设备号 | 功能号 | 寄存器偏移 (双字对齐)
+#define PCI_ADDR(bus, dev, func, offset) \
+    (0x80000000 | ((bus) << 16) | ((dev) << 11) | ((func) << 8) | ((offset) & 0xfc))
+
+// PCI 设备链表
+static list_t pci_device_list;
+
+// 读取配置空间中偏移为 offset 的双字
+static u32 pci_conf_inl(u8 bus, u8 dev, u8 func, u8 offset) {
+    outl(PCI_CONF_ADDR, PCI_ADDR(bus, dev, func, offset));
+    return inl(PCI_CONF_DATA);
+}
+
+// 写入配置空间中偏移为 offset 的双字
+static void pci_conf_outl(u8 bus, u8 dev, u8 func, u8 offset, u32 value) {
+    outl(PCI_CONF_ADDR, PCI_ADDR(bus, dev, func, offset));
+    outl(PCI_CONF_DATA, value);
+}
+
+// 读取 PCI 设备 device 配置空间中偏移为 offset 的双字
+u32 pci_inl(pci_device_t *device, u8 offset) {
+    return pci_conf_inl(device->bus, device->dev, device->func, offset);
+}
+
+// 写入 PCI 设备 device 配置空间中偏移为 offset 的双字
+void pci_outl(pci_device_t *device, u8 offset, u32 value) {
+    pci_conf_outl(device->bus, device->dev, device->func, offset, value);
+}
+
+// 获取 PCI 设备 device 的第 idx 个 type 类型的基址寄存器，成功返回 0，失败返回 EOF
+i32 pci_find_bar(pci_device_t *device, pci_bar_t *bar, size_t idx, i32 type) {
+    for (size_t i = 0; i < PCI_BAR_NR; i++) {
+        u8 offset = PCI_CONF_BASE_ADDR0 + (i << 2);
+        u32 value = pci_inl(device, offset);
+        if (value == 0 || (value & 1) != type) continue;
+        if (idx-- > 0) continue;
+
+        // 写入全 1 后读回，得到基址寄存器的大小
+        pci_outl(device, offset, 0xffffffff);
+        u32 len = pci_inl(device, offset);
+        pci_outl(device, offset, value);
+
+        if (type == PCI_BAR_TYPE_IO) {
+            bar->iobase = value & ~0x3;
+            bar->size = (~(len & ~0x3) + 1) & 0xffff;
+        } else {
+            bar->iobase = value & ~0xf;
+            bar->size = ~(len & ~0xf) + 1;
+        }
+        return 0;
+    }
+    return EOF;
+}
+
+// 允许 PCI 设备 device 作为总线主控进行 DMA
+void pci_enable_busmaster(pci_device_t *device) {
+    u32 data = pci_inl(device, PCI_CONF_COMMAND);
+    data |= PCI_COMMAND_IO | PCI_COMMAND_MEMORY | PCI_COMMAND_MASTER;
+    pci_outl(device, PCI_CONF_COMMAND, data);
+}
+
+// 根据厂商 ID 和设备 ID 查找第 idx 个 PCI 设备，没有则返回 NULL
+pci_device_t *pci_find_device(u16 vendorid, u16 deviceid, size_t idx) {
+    list_t *list = &pci_device_list;
+    for (list_node_t *node = list->head.next; node != &list->tail; node = node->next) {
+        pci_device_t *device = element_entry(pci_device_t, node, node);
+        if (device->vendorid != vendorid || device->deviceid != deviceid) continue;
+        if (idx-- == 0) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+// 根据基类和子类查找第 idx 个 PCI 设备，没有则返回 NULL
+pci_device_t *pci_find_class(u8 base, u8 sub, size_t idx) {
+    list_t *list = &pci_device_list;
+    for (list_node_t *node = list->head.next; node != &list->tail; node = node->next) {
+        pci_device_t *device = element_entry(pci_device_t, node, node);
+        if ((device->classcode >> 8) != ((base << 8) | sub)) continue;
+        if (idx-- == 0) {
+            return device;
+        }
+    }
+    return NULL;
+}
+
+// 检测 PCI 功能，存在则加入设备链表，返回是否存在
+static bool pci_check_device(u8 bus, u8 dev, u8 func) {
+    u32 value = pci_conf_inl(bus, dev, func, PCI_CONF_VENDOR);
+    u16 vendorid = value & 0xffff;
+    if (vendorid == 0 || vendorid == 0xffff) {
+        return false;
+    }
+
+    pci_device_t *device = (pci_device_t *)kmalloc(sizeof(pci_device_t));
+    device->bus = bus;
+    device->dev = dev;
+    device->func = func;
+    device->vendorid = vendorid;
+    device->deviceid = value >> 16;
+
+    value = pci_conf_inl(bus, dev, func, PCI_CONF_REVISION);
+    device->revision = value & 0xff;
+    device->classcode = value >> 8;
+
+    value = pci_conf_inl(bus, dev, func, PCI_CONF_INTERRUPT);
+    device->irq = value & 0xff;
+
+    list_push_back(&pci_device_list, &device->node);
+    LOGK("PCI %02x:%02x.%x %04x:%04x class %06x irq %d\n",
+         bus, dev, func, device->vendorid, device->deviceid, device->classcode, device->irq);
+    return true;
+}
+
+// 枚举所有 PCI 总线上的设备
+static void pci_enum_device() {
+    for (size_t bus = 0; bus < PCI_BUS_NR; bus++) {
+        for (size_t dev = 0; dev < PCI_DEV_NR; dev++) {
+            if (!pci_check_device(bus, dev, 0)) continue;
+
+            // 多功能设备需要检测其余的功能
+            u32 header = pci_conf_inl(bus, dev, 0, PCI_CONF_HEADER);
+            if (!(header & 0x800000)) continue;
+            for (size_t func = 1; func < PCI_FUNC_NR; func++) {
+                pci_check_device(bus, dev, func);
+            }
+        }
+    }
+}
+
+// PCI 总线初始化
+void pci_init() {
+    LOGK("pci init...\n");
+    list_init(&pci_device_list);
+    pci_enum_device();
+}
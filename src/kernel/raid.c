@@ -0,0 +1,222 @@
+#include <xos/raid.h>
+#include <xos/device.h>
+#include <xos/string.h>
+#include <xos/arena.h>
+#include <xos/assert.h>
+#include <xos/debug.h>
+#include <xos/stdlib.h>
+#include <xos/task.h>
+#include <xos/interrupt.h>
+
+// 启动时创建的条带化设备 md0 的成员设备名 (以逗号分隔)，编译时通过 -DRAID_MEMBERS=... 指定
+#ifndef RAID_MEMBERS
+#define RAID_MEMBERS ""
+#endif
+
+// 条带化设备 md0 的条带大小 (扇区数)
+#ifndef RAID_CHUNK
+#define RAID_CHUNK 32
+#endif
+
+static list_t stalled;          // 等待 raid 线程继续提交子请求的条带化设备
+static task_t *raid_waiter;     // 阻塞等待的 raid 线程
+
+// 发送条带化设备控制命令，获取对应信息
+static i32 raid_ioctl(raid_t *raid, dev_cmd_t cmd, void *args, i32 flags) {
+    switch (cmd) {
+    case DEV_CMD_SECTOR_START:
+        return 0;
+    case DEV_CMD_SECTOR_COUNT:
+        return raid->member_sectors * raid->count;
+    case DEV_CMD_SECTOR_MAX:
+        return DEV_MERGE_MAX;
+    default:
+        panic("Unknown device command %d...", cmd);
+        break;
+    }
+}
+
+// 释放一个子请求计数，所有子请求完成后条带化设备的请求完成
+static void raid_put(raid_t *raid) {
+    assert(raid->pending > 0);
+    if (--raid->pending == 0) {
+        request_t *request = raid->request;
+        raid->request = NULL;
+        request_complete(request, raid->ret);
+    }
+}
+
+// 子请求完成 (通常位于中断处理中)
+static void raid_end_io(request_t *req) {
+    raid_t *raid = (raid_t *)req->data;
+    if (req->ret < 0) {
+        raid->ret = EOF;
+    }
+    raid_put(raid);
+}
+
+// 从游标处继续提交子请求，子请求只在条带边界和缓冲区内存不连续处拆分
+// wait 为 false 时成员设备的请求池耗尽则停止提交并返回 false，之后从游标处继续
+static bool raid_submit(raid_t *raid, bool wait) {
+    request_t *req = raid->request;
+
+    // 暂停各个成员设备的请求队列，使同一成员设备上相邻条带的子请求合并为一次设备操作
+    for (size_t i = 0; i < raid->count; i++) {
+        dev_plug(raid->members[i]);
+    }
+
+    bool finished = true;
+    while (raid->done < req->total) {
+        // 扇区所在的条带，以及条带所在的成员设备和成员设备上的扇区
+        size_t sector = req->idx + raid->done;
+        size_t stripe = sector / raid->chunk;
+        size_t inner = sector % raid->chunk;
+        devid_t member = raid->members[stripe % raid->count];
+        size_t idx = (stripe / raid->count) * raid->chunk + inner;
+
+        // 在条带内尽量延伸子请求，合并链表中内存连续的缓冲区
+        void *buf = raid->cursor->buf + raid->offset * SECTOR_SIZE;
+        request_t *ptr = raid->cursor;
+        size_t offset = raid->offset;
+        size_t count = 0;
+        while (ptr && count < raid->chunk - inner &&
+               ptr->buf + offset * SECTOR_SIZE == buf + count * SECTOR_SIZE) {
+            size_t n = MIN(raid->chunk - inner - count, ptr->count - offset);
+            count += n;
+            offset += n;
+            if (offset == ptr->count) {
+                ptr = ptr->next;
+                offset = 0;
+            }
+        }
+
+        raid->pending++;
+        if (wait) {
+            submit_request(member, buf, count, idx, req->flags, req->type, raid_end_io, raid);
+        } else if (!try_submit_request(member, buf, count, idx, req->flags, req->type, raid_end_io, raid)) {
+            raid->pending--;
+            finished = false;
+            break;
+        }
+
+        raid->cursor = ptr;
+        raid->offset = offset;
+        raid->done += count;
+    }
+
+    for (size_t i = 0; i < raid->count; i++) {
+        dev_unplug(raid->members[i]);
+    }
+    return finished;
+}
+
+// 开始执行条带化设备的请求 req，拆分为各个成员设备的子请求
+// 子请求提交后立即返回，不同成员设备的子请求同时进行
+// 请求钩子可能位于中断处理中，不能阻塞，成员设备的请求池耗尽时剩余的子请求交给 raid 线程提交
+static i32 raid_request(raid_t *raid, request_t *req) {
+    assert(raid->request == NULL);
+    raid->request = req;
+    raid->ret = 0;
+    raid->cursor = req;
+    raid->offset = 0;
+    raid->done = 0;
+
+    // 提交子请求期间多持有一个计数，防止同步完成的子请求提前结束整个请求
+    raid->pending = 1;
+
+    if (!raid_submit(raid, false)) {
+        list_push_back(&stalled, &raid->node);
+        if (raid_waiter) {
+            task_unblock(raid_waiter);
+            raid_waiter = NULL;
+        }
+        return 0;
+    }
+
+    raid_put(raid);
+    return 0;
+}
+
+// raid 线程，在任务上下文中阻塞提交请求钩子未能提交的子请求
+void raid_thread() {
+    irq_enable();
+
+    while (true) {
+        u32 irq = irq_disable();
+
+        if (list_empty(&stalled)) {
+            raid_waiter = current_task();
+            task_block(raid_waiter, NULL, TASK_BLOCKED);
+        } else {
+            raid_t *raid = element_entry(raid_t, node, list_pop_front(&stalled));
+            raid_submit(raid, true);
+            raid_put(raid);
+        }
+
+        set_irq_state(irq);
+    }
+}
+
+// 使用 count 个成员设备 members 创建条带大小为 chunk 个扇区的条带化设备 name，失败返回 EOF
+devid_t raid_install(char *name, devid_t *members, size_t count, size_t chunk) {
+    if (count < 2 || count > RAID_MEMBER_NR || chunk < RAID_CHUNK_MIN) {
+        LOGK("raid %s invalid members %d chunk %d\n", name, count, chunk);
+        return EOF;
+    }
+
+    raid_t *raid = (raid_t *)kmalloc(sizeof(raid_t));
+    strncpy(raid->name, name, sizeof(raid->name));
+    raid->count = count;
+    raid->chunk = chunk;
+    raid->request = NULL;
+    raid->pending = 0;
+    raid->ret = 0;
+
+    // 每个成员设备使用相同数量的扇区，由最小的成员设备决定
+    size_t sectors = (size_t)-1;
+    for (size_t i = 0; i < count; i++) {
+        dev_t *dev = dev_get(members[i]);
+        assert(dev->type == DEV_BLOCK);
+        raid->members[i] = members[i];
+        sectors = MIN(sectors, (size_t)dev_ioctl(members[i], DEV_CMD_SECTOR_COUNT, NULL, 0));
+    }
+    raid->member_sectors = sectors - sectors % chunk;
+
+    raid->dev_id = dev_install(DEV_BLOCK, DEV_RAID, raid, raid->name, -1, raid_ioctl, NULL, NULL);
+    dev_install_request(raid->dev_id, raid_request);
+
+    LOGK("raid %s members %d chunk %d sectors %d\n",
+         raid->name, count, chunk, raid->member_sectors * count);
+    return raid->dev_id;
+}
+
+// 根据 RAID_MEMBERS 配置的成员设备名创建条带化设备 md0
+void raid_init() {
+    list_init(&stalled);
+
+    char names[] = RAID_MEMBERS;
+    devid_t members[RAID_MEMBER_NR];
+    size_t count = 0;
+
+    char *name = names;
+    while (*name && count < RAID_MEMBER_NR) {
+        char *next = strchr(name, ',');
+        if (next) {
+            *next++ = EOS;
+        }
+
+        dev_t *dev = dev_find_name(name);
+        if (dev == NULL || dev->type != DEV_BLOCK) {
+            LOGK("raid member %s not found...\n", name);
+            return;
+        }
+        members[count++] = dev->dev_id;
+
+        if (next == NULL) break;
+        name = next;
+    }
+
+    if (count > 0) {
+        raid_install("md0", members, count, RAID_CHUNK);
+    }
+}
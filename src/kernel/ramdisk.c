@@ -0,0 +1,72 @@
+#include <xos/ramdisk.h>
+#include <xos/memory.h>
+#include <xos/string.h>
+#include <xos/assert.h>
+#include <xos/debug.h>
+#include <xos/fs.h>
+
+static ramdisk_t ramdisks[RAMDISK_NR];  // 内存虚拟磁盘
+static size_t ramdisk_count;            // 内存虚拟磁盘数量
+
+// 发送虚拟磁盘控制命令，获取对应信息
+static i32 ramdisk_ioctl(ramdisk_t *disk, dev_cmd_t cmd, void *args, i32 flags) {
+    switch (cmd) {
+    case DEV_CMD_SECTOR_START:
+        return 0;
+    case DEV_CMD_SECTOR_COUNT:
+        return disk->count;
+    case DEV_CMD_SECTOR_MAX:
+        return DEV_MERGE_MAX;
+    default:
+        panic("Unknown device command %d...", cmd);
+        break;
+    }
+}
+
+// 从虚拟磁盘 disk 的第 lba 个扇区开始，读取连续 count 个扇区的数据到缓冲区 buf
+static i32 ramdisk_read(ramdisk_t *disk, void *buf, size_t count, size_t lba) {
+    if (lba >= disk->count || count > disk->count - lba) {
+        return EOF;
+    }
+    memcpy(buf, disk->start + lba * SECTOR_SIZE, count * SECTOR_SIZE);
+    return 0;
+}
+
+// 将缓冲区 buf 的数据写入虚拟磁盘 disk 的第 lba 个扇区开始的连续 count 个扇区
+static i32 ramdisk_write(ramdisk_t *disk, void *buf, size_t count, size_t lba) {
+    if (lba >= disk->count || count > disk->count - lba) {
+        return EOF;
+    }
+    memcpy(disk->start + lba * SECTOR_SIZE, buf, count * SECTOR_SIZE);
+    return 0;
+}
+
+// 使用起始地址为 start、大小为 size 字节的内存创建虚拟磁盘 name，失败返回 EOF
+// 虚拟磁盘没有请求队列，请求不经过 I/O 调度器，提交时直接同步完成
+devid_t ramdisk_install(char *name, void *start, size_t size) {
+    if (ramdisk_count == RAMDISK_NR || size < SECTOR_SIZE) {
+        return EOF;
+    }
+
+    ramdisk_t *disk = &ramdisks[ramdisk_count++];
+    strncpy(disk->name, name, sizeof(disk->name));
+    disk->start = (u8 *)start;
+    disk->count = size / SECTOR_SIZE;
+
+    LOGK("ramdisk %s start 0x%p sectors %d\n", disk->name, disk->start, disk->count);
+    return dev_install(DEV_BLOCK, DEV_RAMDISK, disk, disk->name, -1,
+                       ramdisk_ioctl, ramdisk_read, ramdisk_write);
+}
+
+// 使用内核保留的虚拟磁盘区域创建 rd0
+// 启动时加载了 initrd 则直接使用其中的文件系统，否则格式化为空的 MINIX 文件系统
+void ramdisk_init() {
+    if (KERNEL_RAMDISK_SIZE == 0) {
+        return;
+    }
+
+    devid_t dev_id = ramdisk_install("rd0", (void *)KERNEL_RAMDISK_BASE, KERNEL_RAMDISK_SIZE);
+    if (dev_id >= 0 && get_initrd_size() == 0) {
+        minix_mkfs(dev_id);
+    }
+}
@@ -14,11 +14,14 @@ extern void sys_fork();
 extern pid_t sys_waitpid(pid_t pid, i32 *status);
 extern time_t sys_time();
 extern pid_t sys_getpid();
+extern i32 sys_sync();
 extern i32 sys_brk(void *addr);
 extern mode_t sys_umask(mode_t mask);
 extern pid_t sys_getppid();
 extern void sys_yield();
 extern void sys_sleep(u32 ms);
+extern i32 sys_bufstat(buffer_stat_t *info);
+extern i32 sys_iostat(devid_t dev_id, dev_stat_t *stat);
 
 // 系统调用处理函数列表
 handler_t syscall_table[SYSCALL_SIZE];
@@ -79,4 +82,7 @@ void syscall_init() {
     syscall_table[SYS_WAITPID]  = sys_waitpid;
     syscall_table[SYS_TIME]     = sys_time;
     syscall_table[SYS_UMASK]    = sys_umask;
+    syscall_table[SYS_SYNC]     = sys_sync;
+    syscall_table[SYS_BUFSTAT]  = sys_bufstat;
+    syscall_table[SYS_IOSTAT]   = sys_iostat;
 }
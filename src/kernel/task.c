@@ -355,6 +355,11 @@ static void task_build_stack(task_t *task) {
 extern void idle_thread();
 extern void init_thread();
 extern void test_thread();
+extern void flush_thread();
+extern void readahead_thread();
+extern void ata_thread();
+extern void cache_thread();
+extern void raid_thread();
 
 // 初始化任务管理
 void task_init() {
@@ -366,6 +371,11 @@ void task_init() {
     idle_task = task_create((target_t)idle_thread, "idle", 1, KERNEL_TASK);
     task_create((target_t)init_thread, "init", 5, USER_TASK);
     task_create((target_t)test_thread, "test", 5, KERNEL_TASK);
+    task_create((target_t)flush_thread, "flush", 5, KERNEL_TASK);
+    task_create((target_t)readahead_thread, "readahead", 5, KERNEL_TASK);
+    task_create((target_t)ata_thread, "ata", 5, KERNEL_TASK);
+    task_create((target_t)cache_thread, "cache", 5, KERNEL_TASK);
+    task_create((target_t)raid_thread, "raid", 5, KERNEL_TASK);
 }
 
 /*******************************
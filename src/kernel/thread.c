@@ -7,6 +7,7 @@
 #include <xos/stdio.h>
 #include <xos/arena.h>
 #include <xos/stdlib.h>
+#include <xos/builtin.h>
 
 // 空闲任务 idle
 void idle_thread() {
@@ -25,10 +26,20 @@ void idle_thread() {
 
 #define UBMB asm volatile("xchgw %bx, %bx");
 
+// init 周期性打印统计信息的间隔 (毫秒)，编译时通过 -DSTAT_INTERVAL=... 指定，为 0 则不打印
+#ifndef STAT_INTERVAL
+#define STAT_INTERVAL 0
+#endif
+
 // 初始化任务 init 的用户态线程
 static void user_init_thread() {
+    u32 interval = STAT_INTERVAL > 0 ? STAT_INTERVAL : 1000;
     while (true) {
-        sleep(1000);
+        if (STAT_INTERVAL > 0) {
+            bufstat_main();
+            iostat_main();
+        }
+        sleep(interval);
     }
 }
 
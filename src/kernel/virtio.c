@@ -0,0 +1,463 @@
+#include <xos/virtio.h>
+#include <xos/stdio.h>
+#include <xos/io.h>
+#include <xos/interrupt.h>
+#include <xos/memory.h>
+#include <xos/string.h>
+#include <xos/assert.h>
+#include <xos/debug.h>
+#include <xos/pci.h>
+#include <xos/stdlib.h>
+
+// virtio 块设备的 PCI 厂商 ID 和设备 ID (传统接口)
+#define VIRTIO_VENDOR_ID    0x1af4
+#define VIRTIO_BLK_ID       0x1001
+
+// 传统接口 I/O 寄存器偏移
+#define VIRTIO_IO_DEVICE_FEATURES   0x00    // 设备支持的特性
+#define VIRTIO_IO_GUEST_FEATURES    0x04    // 驱动程序使用的特性
+#define VIRTIO_IO_QUEUE_PFN         0x08    // 虚拟队列的物理页号
+#define VIRTIO_IO_QUEUE_SIZE        0x0c    // 虚拟队列大小
+#define VIRTIO_IO_QUEUE_SELECT      0x0e    // 选择虚拟队列
+#define VIRTIO_IO_QUEUE_NOTIFY      0x10    // 通知设备处理虚拟队列
+#define VIRTIO_IO_STATUS            0x12    // 设备状态
+#define VIRTIO_IO_ISR               0x13    // 中断状态，读取后清除
+#define VIRTIO_IO_CONFIG            0x14    // 设备配置 (块设备为 64 位的扇区数量)
+
+// 设备状态
+#define VIRTIO_STATUS_ACKNOWLEDGE   0x01    // 已发现设备
+#define VIRTIO_STATUS_DRIVER        0x02    // 已找到驱动程序
+#define VIRTIO_STATUS_DRIVER_OK     0x04    // 驱动程序已就绪
+#define VIRTIO_STATUS_FAILED        0x80    // 驱动程序初始化失败
+
+// 设备特性
+#define VIRTIO_F_INDIRECT_DESC      (1 << 28)   // 支持间接描述符
+#define VIRTIO_F_EVENT_IDX          (1 << 29)   // 支持事件索引
+
+// 描述符标志
+#define VRING_DESC_F_NEXT       1   // 描述符链中还有下一个描述符
+#define VRING_DESC_F_WRITE      2   // 设备写入该缓冲区
+#define VRING_DESC_F_INDIRECT   4   // 缓冲区为间接描述符表
+
+// 环标志
+#define VRING_AVAIL_F_NO_INTERRUPT  1   // 驱动程序不需要完成中断
+#define VRING_USED_F_NO_NOTIFY      1   // 设备不需要可用通知
+
+// 块设备请求类型和状态
+#define VIRTIO_BLK_T_IN     0   // 读
+#define VIRTIO_BLK_T_OUT    1   // 写
+#define VIRTIO_BLK_S_OK     0   // 成功
+
+#define VIRTIO_QUEUE_ALIGN  PAGE_SIZE   // 传统接口中已用环按页对齐
+#define VIRTIO_SPIN_MAX     10000000    // 同步请求轮询已用环的最大次数
+
+// 禁止编译器重排内存访问
+#define barrier() asm volatile("" ::: "memory")
+// 保证之前的写入在之后的读取之前完成 (x86 只会将读取重排到写入之前)
+#define mb() asm volatile("lock; addl $0, 0(%%esp)" ::: "memory")
+
+static virtio_blk_t blks[VIRTIO_BLK_NR];   // virtio 块设备
+static size_t blk_count;                    // virtio 块设备数量
+
+// 虚拟队列占用的字节数：描述符表和可用环，对齐后是已用环
+static u32 vring_size(u16 size) {
+    u32 avail = sizeof(vring_desc_t) * size + sizeof(u16) * (3 + size);
+    avail = div_round_up(avail, VIRTIO_QUEUE_ALIGN) * VIRTIO_QUEUE_ALIGN;
+    return avail + sizeof(u16) * 3 + sizeof(vring_used_elem_t) * size;
+}
+
+// 驱动程序希望设备在已用环到达该位置时产生中断
+static _inline volatile u16 *vring_used_event(virtio_blk_t *blk) {
+    return &blk->avail->ring[blk->size];
+}
+
+// 设备希望驱动程序在可用环到达该位置时发出通知
+static _inline volatile u16 *vring_avail_event(virtio_blk_t *blk) {
+    return (volatile u16 *)&blk->used->ring[blk->size];
+}
+
+// 可用环从 old 前进到 now 的过程中是否越过了设备设置的事件索引 event
+static _inline bool vring_need_event(u16 event, u16 now, u16 old) {
+    return (u16)(now - event - 1) < (u16)(now - old);
+}
+
+// 根据请求 req 构造命令槽 slot 的间接描述符表，返回描述符数量，失败返回 0
+static size_t virtio_prepare(virtio_blk_t *blk, u8 slot, request_t *req, req_type_t type, size_t lba) {
+    virtio_blk_slot_t *ptr = &blk->slots[slot];
+    vring_desc_t *table = ptr->table;
+
+    ptr->header.type = type == REQ_READ ? VIRTIO_BLK_T_IN : VIRTIO_BLK_T_OUT;
+    ptr->header.reserved = 0;
+    ptr->header.sector = lba;
+    ptr->status = 0xff;
+
+    // 请求头由设备读取
+    table[0].addr = (u32)&ptr->header;
+    table[0].len = sizeof(virtio_blk_header_t);
+    table[0].flags = VRING_DESC_F_NEXT;
+    size_t count = 1;
+
+    u16 flags = VRING_DESC_F_NEXT | (type == REQ_READ ? VRING_DESC_F_WRITE : 0);
+    for (request_t *node = req; node; node = node->next) {
+        u32 addr = (u32)node->buf;
+        u32 len = node->count * SECTOR_SIZE;
+
+        // 设备使用物理地址，缓冲区必须位于恒等映射的内核内存
+        if (addr + len > KERNEL_MEMORY_SIZE) {
+            return 0;
+        }
+
+        // 物理地址连续的缓冲区使用同一个描述符
+        vring_desc_t *prev = &table[count - 1];
+        if (count > 1 && (u32)prev->addr + prev->len == addr) {
+            prev->len += len;
+            continue;
+        }
+
+        assert(count < VIRTIO_DESC_NR - 1);
+        table[count].addr = addr;
+        table[count].len = len;
+        table[count].flags = flags;
+        count++;
+    }
+
+    // 状态字节由设备写入
+    table[count].addr = (u32)&ptr->status;
+    table[count].len = 1;
+    table[count].flags = VRING_DESC_F_WRITE;
+    count++;
+
+    for (size_t i = 0; i < count - 1; i++) {
+        table[i].next = i + 1;
+    }
+    table[count - 1].next = 0;
+    return count;
+}
+
+// 将命令槽 slot 放入可用环，只在设备需要时发出通知，减少虚拟机退出
+static void virtio_issue(virtio_blk_t *blk, u8 slot, size_t count) {
+    // 每个命令槽固定使用同一个描述符，指向命令槽的间接描述符表
+    vring_desc_t *desc = &blk->desc[slot];
+    desc->addr = (u32)blk->slots[slot].table;
+    desc->len = count * sizeof(vring_desc_t);
+    desc->flags = VRING_DESC_F_INDIRECT;
+    desc->next = 0;
+
+    vring_avail_t *avail = blk->avail;
+    u16 old = avail->idx;
+    avail->ring[old % blk->size] = slot;
+    barrier();
+    avail->idx = old + 1;
+    mb();
+
+    bool notify;
+    if (blk->event_idx) {
+        notify = vring_need_event(*vring_avail_event(blk), old + 1, old);
+    } else {
+        notify = !(((volatile vring_used_t *)blk->used)->flags & VRING_USED_F_NO_NOTIFY);
+    }
+    if (notify) {
+        outw(blk->iobase + VIRTIO_IO_QUEUE_NOTIFY, 0);
+    }
+}
+
+// 获取空闲的命令槽，没有则返回 EOF
+static i32 virtio_slot(virtio_blk_t *blk) {
+    for (u8 slot = 0; slot < blk->depth; slot++) {
+        if (!(blk->issued & (1 << slot))) {
+            return slot;
+        }
+    }
+    return EOF;
+}
+
+// 处理已用环中设备完成的请求，完成请求时设备层可能会发出下一个请求
+static void virtio_complete(virtio_blk_t *blk) {
+    volatile vring_used_t *used = blk->used;
+
+    while (true) {
+        while (blk->last_used != used->idx) {
+            barrier();
+            u8 slot = used->ring[blk->last_used % blk->size].id;
+            blk->last_used++;
+
+            virtio_blk_slot_t *ptr = &blk->slots[slot];
+            request_t *req = ptr->request;
+            ptr->request = NULL;
+            blk->issued &= ~(1 << slot);
+            if (req) {
+                request_complete(req, ptr->status == VIRTIO_BLK_S_OK ? 0 : EOF);
+            }
+        }
+
+        // 重新允许中断后再检查一次，避免遗漏在此期间完成的请求
+        if (blk->event_idx) {
+            *vring_used_event(blk) = blk->last_used;
+        } else {
+            blk->avail->flags &= ~VRING_AVAIL_F_NO_INTERRUPT;
+        }
+        mb();
+        if (blk->last_used == used->idx) {
+            break;
+        }
+        if (!blk->event_idx) {
+            blk->avail->flags |= VRING_AVAIL_F_NO_INTERRUPT;
+        }
+    }
+}
+
+// 同步读写块设备 blk 从第 lba 个扇区开始的 count 个扇区，轮询等待请求完成
+static i32 virtio_rw(virtio_blk_t *blk, void *buf, size_t count, size_t lba, req_type_t type) {
+    i32 slot = virtio_slot(blk);
+    if (slot < 0 || count == 0 || count > DEV_MERGE_MAX) {
+        return EOF;
+    }
+
+    request_t req;
+    req.buf = buf;
+    req.count = count;
+    req.next = NULL;
+    size_t descs = virtio_prepare(blk, slot, &req, type, lba);
+    if (descs == 0) {
+        return EOF;
+    }
+
+    blk->slots[slot].request = NULL;
+    blk->issued |= 1 << slot;
+    virtio_issue(blk, slot, descs);
+
+    for (size_t i = 0; blk->issued & (1 << slot); i++) {
+        if (i == VIRTIO_SPIN_MAX) {
+            LOGK("block %s request timeout\n", blk->name);
+            return EOF;
+        }
+        virtio_complete(blk);
+    }
+    return blk->slots[slot].status == VIRTIO_BLK_S_OK ? 0 : EOF;
+}
+
+// 发送块设备控制命令，获取对应信息
+static i32 virtio_ioctl(virtio_blk_t *blk, dev_cmd_t cmd, void *args, i32 flags) {
+    switch (cmd) {
+    case DEV_CMD_SECTOR_START:
+        return 0;
+    case DEV_CMD_SECTOR_COUNT:
+        return blk->total_lba;
+    case DEV_CMD_SECTOR_MAX:
+        return DEV_MERGE_MAX;
+    default:
+        panic("Unknown device command %d...", cmd);
+        break;
+    }
+}
+
+// 从块设备 blk 的第 lba 个扇区开始，读取连续 count 个扇区的数据到缓冲区 buf
+static i32 virtio_read(virtio_blk_t *blk, void *buf, size_t count, size_t lba) {
+    return virtio_rw(blk, buf, count, lba, REQ_READ);
+}
+
+// 将缓冲区 buf 的数据写入块设备 blk 的第 lba 个扇区开始的连续 count 个扇区
+static i32 virtio_write(virtio_blk_t *blk, void *buf, size_t count, size_t lba) {
+    return virtio_rw(blk, buf, count, lba, REQ_WRITE);
+}
+
+// 开始执行块设备 blk 的请求 req，每个请求占用一个命令槽，多个请求同时位于虚拟队列中
+static i32 virtio_request(virtio_blk_t *blk, request_t *req) {
+    ASSERT_IRQ_DISABLE();   // 保证中断禁止
+
+    i32 slot = virtio_slot(blk);
+    if (slot < 0) {
+        return EOF;
+    }
+
+    size_t descs = virtio_prepare(blk, slot, req, req->type, req->idx);
+    if (descs == 0) {
+        LOGK("block %s buffer unavailable for DMA\n", blk->name);
+        return EOF;
+    }
+
+    blk->slots[slot].request = req;
+    blk->issued |= 1 << slot;
+    virtio_issue(blk, slot, descs);
+    return 0;
+}
+
+// virtio 块设备中断处理
+static void virtio_handler(int vector) {
+    send_eoi(vector);
+
+    // 中断线可能由多个设备共享，读取中断状态确认中断来源并清除中断
+    for (size_t i = 0; i < blk_count; i++) {
+        virtio_blk_t *blk = &blks[i];
+        if (blk->irq + IRQ_MASTER_NR != vector) continue;
+        if (inb(blk->iobase + VIRTIO_IO_ISR) & 1) {
+            virtio_complete(blk);
+        }
+    }
+}
+
+// 从分区 part 的第 lba 个扇区开始读取
+static i32 virtio_partition_read(virtio_partition_t *part, void *buf, size_t count, size_t lba) {
+    return virtio_read(part->blk, buf, count, part->start_lba + lba);
+}
+
+// 从分区 part 的第 lba 个扇区开始写入
+static i32 virtio_partition_write(virtio_partition_t *part, void *buf, size_t count, size_t lba) {
+    return virtio_write(part->blk, buf, count, part->start_lba + lba);
+}
+
+// 发送分区控制命令，获取对应信息
+static i32 virtio_partition_ioctl(virtio_partition_t *part, dev_cmd_t cmd, void *args, i32 flags) {
+    switch (cmd) {
+    case DEV_CMD_SECTOR_START:
+        return part->start_lba;
+    case DEV_CMD_SECTOR_COUNT:
+        return part->count;
+    case DEV_CMD_SECTOR_MAX:
+        return DEV_MERGE_MAX;
+    default:
+        panic("Unknown device command %d...", cmd);
+        break;
+    }
+}
+
+// 扫描块设备的分区表，目前只支持主分区
+static void virtio_partition(virtio_blk_t *blk, u16 *buf) {
+    if (virtio_read(blk, buf, 1, 0) < 0) {
+        return;
+    }
+    mbr_t *mbr = (mbr_t *)buf;
+
+    for (size_t i = 0; i < ATA_PARTITION_NR; i++) {
+        partition_entry_t *entry = &mbr->partition_table[i];
+        virtio_partition_t *part = &blk->parts[i];
+
+        // 分区不存在
+        if (entry->count == 0 || entry->system == PARTITION_FS_EXTENDED) {
+            part->count = 0;
+            continue;
+        }
+
+        sprintf(part->name, "%s%d", blk->name, i + 1);
+        LOGK("partition %s start %d count %d system 0x%x\n",
+             part->name, entry->start_lba, entry->count, entry->system);
+
+        part->blk = blk;
+        part->system = entry->system;
+        part->start_lba = entry->start_lba;
+        part->count = entry->count;
+    }
+}
+
+// 初始化 PCI 设备 device 对应的 virtio 块设备：协商特性，设置虚拟队列，成功返回 0
+static i32 virtio_blk_init(virtio_blk_t *blk, pci_device_t *device) {
+    pci_bar_t bar;
+    if (pci_find_bar(device, &bar, 0, PCI_BAR_TYPE_IO) < 0) {
+        return EOF;
+    }
+    sprintf(blk->name, "vd%c", 'a' + blk_count);
+    blk->iobase = bar.iobase;
+    blk->irq = device->irq;
+    pci_enable_busmaster(device);
+
+    // 复位设备，之后依次设置状态
+    u16 iobase = blk->iobase;
+    outb(iobase + VIRTIO_IO_STATUS, 0);
+    outb(iobase + VIRTIO_IO_STATUS, VIRTIO_STATUS_ACKNOWLEDGE);
+    outb(iobase + VIRTIO_IO_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER);
+
+    // 每个请求使用一个间接描述符，不支持间接描述符的设备无法容纳合并后的请求
+    u32 features = inl(iobase + VIRTIO_IO_DEVICE_FEATURES);
+    outw(iobase + VIRTIO_IO_QUEUE_SELECT, 0);
+    u16 size = inw(iobase + VIRTIO_IO_QUEUE_SIZE);
+    if (!(features & VIRTIO_F_INDIRECT_DESC) || size == 0) {
+        LOGK("block %s unsupported features 0x%x queue size %d\n", blk->name, features, size);
+        outb(iobase + VIRTIO_IO_STATUS, VIRTIO_STATUS_FAILED);
+        return EOF;
+    }
+    features &= VIRTIO_F_INDIRECT_DESC | VIRTIO_F_EVENT_IDX;
+    outl(iobase + VIRTIO_IO_GUEST_FEATURES, features);
+    blk->event_idx = (features & VIRTIO_F_EVENT_IDX) != 0;
+
+    // 虚拟队列需要物理连续并且按页对齐，内核页是恒等映射的
+    u32 pages = div_round_up(vring_size(size), PAGE_SIZE);
+    u32 vring = kalloc_page(pages);
+    memset((void *)vring, 0, pages * PAGE_SIZE);
+    blk->size = size;
+    blk->depth = MIN(size, VIRTIO_SLOT_NR);
+    blk->issued = 0;
+    blk->last_used = 0;
+    blk->desc = (vring_desc_t *)vring;
+    blk->avail = (vring_avail_t *)(vring + sizeof(vring_desc_t) * size);
+    blk->used = (vring_used_t *)(vring + vring_size(size) - sizeof(u16) * 3 - sizeof(vring_used_elem_t) * size);
+    outl(iobase + VIRTIO_IO_QUEUE_PFN, PAGE_IDX(vring));
+
+    u32 slot_pages = div_round_up(sizeof(virtio_blk_slot_t) * VIRTIO_SLOT_NR, PAGE_SIZE);
+    blk->slots = (virtio_blk_slot_t *)kalloc_page(slot_pages);
+    memset(blk->slots, 0, slot_pages * PAGE_SIZE);
+
+    outb(iobase + VIRTIO_IO_STATUS, VIRTIO_STATUS_ACKNOWLEDGE | VIRTIO_STATUS_DRIVER | VIRTIO_STATUS_DRIVER_OK);
+
+    // 设备配置的前 8 字节为扇区数量，超过 32 位时只使用低 32 位可以表示的部分
+    u32 low = inl(iobase + VIRTIO_IO_CONFIG);
+    u32 high = inl(iobase + VIRTIO_IO_CONFIG + 4);
+    blk->total_lba = high ? 0xffffffff : low;
+
+    LOGK("block %s io 0x%x irq %d sectors %d queue %d event idx %d\n",
+         blk->name, blk->iobase, blk->irq, blk->total_lba, blk->size, blk->event_idx);
+    return 0;
+}
+
+// 安装块设备
+static void virtio_device_install() {
+    for (size_t i = 0; i < blk_count; i++) {
+        virtio_blk_t *blk = &blks[i];
+
+        // 请求同时位于虚拟队列中，由宿主机决定执行顺序
+        devid_t dev_id = dev_install(DEV_BLOCK, DEV_VIRTIO_DISK, blk, blk->name, -1,
+                                     virtio_ioctl, virtio_read, virtio_write);
+        dev_install_request(dev_id, virtio_request);
+        dev_ioctl(dev_id, DEV_CMD_QUEUE_DEPTH, (void *)(u32)blk->depth, 0);
+
+        for (size_t pidx = 0; pidx < ATA_PARTITION_NR; pidx++) {
+            virtio_partition_t *part = &blk->parts[pidx];
+
+            // 分区不存在
+            if (part->count == 0) continue;
+            // 安装分区设备，分区的请求会转换为对块设备的请求
+            dev_install(DEV_BLOCK, DEV_VIRTIO_PART, part, part->name, dev_id,
+                        virtio_partition_ioctl, virtio_partition_read,
+                        virtio_partition_write);
+        }
+    }
+}
+
+// 查找 virtio 块设备并初始化
+void virtio_init() {
+    u16 *buf = (u16 *)kalloc_page(1);
+    pci_device_t *device;
+
+    blk_count = 0;
+    for (size_t i = 0; blk_count < VIRTIO_BLK_NR && (device = pci_find_device(VIRTIO_VENDOR_ID, VIRTIO_BLK_ID, i)); i++) {
+        virtio_blk_t *blk = &blks[blk_count];
+        if (virtio_blk_init(blk, device) < 0) continue;
+
+        memset((void *)buf, 0, PAGE_SIZE);
+        virtio_partition(blk, buf);
+        blk_count++;
+
+        // 注册中断，并取消对应的屏蔽字
+        set_interrupt_handler(blk->irq, virtio_handler);
+        set_interrupt_mask(blk->irq, true);
+        if (blk->irq >= 8) {
+            set_interrupt_mask(IRQ_CASCADE, true);
+        }
+    }
+    kfree_page((u32)buf, 1);
+
+    if (blk_count == 0) {
+        LOGK("virtio block device not found\n");
+        return;
+    }
+    virtio_device_install();
+}
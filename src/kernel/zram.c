@@ -0,0 +1,265 @@
+#include <xos/zram.h>
+#include <xos/lz4.h>
+#include <xos/memory.h>
+#include <xos/arena.h>
+#include <xos/string.h>
+#include <xos/stdlib.h>
+#include <xos/assert.h>
+#include <xos/debug.h>
+#include <xos/fs.h>
+
+// 压缩内存虚拟磁盘 zram0 的容量 (字节)，编译时通过 -DZRAM_SIZE=... 指定，为 0 则不创建
+#ifndef ZRAM_SIZE
+#define ZRAM_SIZE 0x800000
+#endif
+
+#define ZRAM_BLOCK_SECS (ZRAM_BLOCK_SIZE / SECTOR_SIZE) // 每块的扇区数
+
+#if ZRAM_BLOCK_SIZE * 2 + LZ4_HASH_SIZE * 2 > PAGE_SIZE
+#error "zram buffers exceed one page"
+#endif
+
+static zram_t zram;
+
+// 大小类别 class 的对象字节数
+static _inline size_t zram_class_size(u8 class) {
+    return (class + 1) * ZRAM_CLASS_SIZE;
+}
+
+// 大小类别 class 每页可以存放的对象数量
+static _inline size_t zram_class_objs(u8 class) {
+    return PAGE_SIZE / zram_class_size(class);
+}
+
+// 压缩对象的地址
+static _inline u8 *zram_object(zram_handle_t *handle) {
+    return (u8 *)handle->page->addr + handle->index * zram_class_size(handle->page->class);
+}
+
+// 为 size 字节的压缩对象分配空间，设置句柄 handle，内核空闲页不足时返回 EOF
+static i32 zram_alloc(zram_t *zram, zram_handle_t *handle, size_t size) {
+    u8 class = div_round_up(size, ZRAM_CLASS_SIZE) - 1;
+    size_t objs = zram_class_objs(class);
+    list_t *list = &zram->classes[class];
+
+    // 链表头部的页没有空闲对象时，分配新页；压缩磁盘不占用内核保留的空闲页
+    zram_page_t *page = NULL;
+    if (!list_empty(list)) {
+        page = element_entry(zram_page_t, node, list->head.next);
+    }
+    if (page == NULL || page->used == objs) {
+        if (kernel_free_pages() <= KERNEL_PAGES_LOW) {
+            return EOF;
+        }
+        page = (zram_page_t *)kmalloc(sizeof(zram_page_t));
+        page->addr = kalloc_page(1);
+        page->class = class;
+        page->used = 0;
+        page->bitmap[0] = page->bitmap[1] = 0;
+        list_push_front(list, &page->node);
+        zram->pages++;
+    }
+
+    u16 index = 0;
+    while (page->bitmap[index / 32] & (1 << (index % 32))) {
+        index++;
+    }
+    page->bitmap[index / 32] |= 1 << (index % 32);
+    page->used++;
+
+    // 页已满时移到链表尾部，保证有空闲对象的页位于链表头部
+    if (page->used == objs) {
+        list_remove(&page->node);
+        list_push_back(list, &page->node);
+    }
+
+    handle->page = page;
+    handle->index = index;
+    handle->size = size;
+    zram->stored += size;
+    return 0;
+}
+
+// 释放句柄 handle 对应的压缩对象，页中没有对象时释放该页
+static void zram_free(zram_t *zram, zram_handle_t *handle) {
+    zram_page_t *page = handle->page;
+    if (page == NULL) {
+        zram->zeros--;
+        return;
+    }
+
+    zram->stored -= handle->size;
+    handle->page = NULL;
+
+    page->bitmap[handle->index / 32] &= ~(1 << (handle->index % 32));
+    list_remove(&page->node);
+    if (--page->used == 0) {
+        kfree_page(page->addr, 1);
+        kfree(page);
+        zram->pages--;
+        return;
+    }
+    list_push_front(&zram->classes[page->class], &page->node);
+}
+
+// 读取第 nr 块到 buf
+static i32 zram_read_block(zram_t *zram, size_t nr, u8 *buf) {
+    zram_handle_t *handle = &zram->table[nr];
+    if (handle->page == NULL) {
+        memset(buf, 0, ZRAM_BLOCK_SIZE);
+        return 0;
+    }
+    if (handle->size == ZRAM_BLOCK_SIZE) {
+        memcpy(buf, zram_object(handle), ZRAM_BLOCK_SIZE);
+        return 0;
+    }
+    i32 size = lz4_decompress(zram_object(handle), handle->size, buf, ZRAM_BLOCK_SIZE);
+    return size == ZRAM_BLOCK_SIZE ? 0 : EOF;
+}
+
+// 判断块 buf 是否全零
+static bool zram_zero_block(u8 *buf) {
+    u32 *ptr = (u32 *)buf;
+    for (size_t i = 0; i < ZRAM_BLOCK_SIZE / sizeof(u32); i++) {
+        if (ptr[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 将 buf 压缩后写入第 nr 块，全零块不占用内存，无法有效压缩的块原样保存
+static i32 zram_write_block(zram_t *zram, size_t nr, u8 *buf) {
+    zram_handle_t *handle = &zram->table[nr];
+
+    if (zram_zero_block(buf)) {
+        zram_free(zram, handle);
+        zram->zeros++;
+        return 0;
+    }
+
+    // 压缩后至少节省一个大小类别才保存压缩结果
+    size_t size = lz4_compress(buf, ZRAM_BLOCK_SIZE, zram->compressed,
+                               ZRAM_BLOCK_SIZE - ZRAM_CLASS_SIZE, zram->hash);
+    u8 *data = zram->compressed;
+    if (size == 0) {
+        size = ZRAM_BLOCK_SIZE;
+        data = buf;
+    }
+
+    // 先分配新对象，成功后才释放原有对象，分配失败时该块保持原有数据
+    zram_handle_t object;
+    if (zram_alloc(zram, &object, size) < 0) {
+        return EOF;
+    }
+    memcpy(zram_object(&object), data, size);
+
+    zram_free(zram, handle);
+    *handle = object;
+    return 0;
+}
+
+// 发送压缩磁盘控制命令，获取对应信息
+static i32 zram_ioctl(zram_t *zram, dev_cmd_t cmd, void *args, i32 flags) {
+    switch (cmd) {
+    case DEV_CMD_SECTOR_START:
+        return 0;
+    case DEV_CMD_SECTOR_COUNT:
+        return zram->blocks * ZRAM_BLOCK_SECS;
+    case DEV_CMD_SECTOR_MAX:
+        return DEV_MERGE_MAX;
+    default:
+        panic("Unknown device command %d...", cmd);
+        break;
+    }
+}
+
+// 从压缩磁盘 zram 的第 lba 个扇区开始，读取连续 count 个扇区的数据到缓冲区 buf
+static i32 zram_read(zram_t *zram, void *buf, size_t count, size_t lba) {
+    if (lba >= zram->blocks * ZRAM_BLOCK_SECS || count > zram->blocks * ZRAM_BLOCK_SECS - lba) {
+        return EOF;
+    }
+
+    u8 *ptr = (u8 *)buf;
+    while (count > 0) {
+        size_t nr = lba / ZRAM_BLOCK_SECS;
+        size_t offset = lba % ZRAM_BLOCK_SECS;
+        size_t secs = MIN(count, ZRAM_BLOCK_SECS - offset);
+
+        // 完整的块直接解压到 buf，否则先解压到块缓冲区
+        if (secs == ZRAM_BLOCK_SECS) {
+            if (zram_read_block(zram, nr, ptr) < 0) return EOF;
+        } else {
+            if (zram_read_block(zram, nr, zram->block) < 0) return EOF;
+            memcpy(ptr, zram->block + offset * SECTOR_SIZE, secs * SECTOR_SIZE);
+        }
+
+        ptr += secs * SECTOR_SIZE;
+        lba += secs;
+        count -= secs;
+    }
+    return 0;
+}
+
+// 将缓冲区 buf 的数据写入压缩磁盘 zram 的第 lba 个扇区开始的连续 count 个扇区
+static i32 zram_write(zram_t *zram, void *buf, size_t count, size_t lba) {
+    if (lba >= zram->blocks * ZRAM_BLOCK_SECS || count > zram->blocks * ZRAM_BLOCK_SECS - lba) {
+        return EOF;
+    }
+
+    u8 *ptr = (u8 *)buf;
+    while (count > 0) {
+        size_t nr = lba / ZRAM_BLOCK_SECS;
+        size_t offset = lba % ZRAM_BLOCK_SECS;
+        size_t secs = MIN(count, ZRAM_BLOCK_SECS - offset);
+
+        // 不完整的块需要先读出原有数据再合并
+        if (secs == ZRAM_BLOCK_SECS) {
+            if (zram_write_block(zram, nr, ptr) < 0) return EOF;
+        } else {
+            if (zram_read_block(zram, nr, zram->block) < 0) return EOF;
+            memcpy(zram->block + offset * SECTOR_SIZE, ptr, secs * SECTOR_SIZE);
+            if (zram_write_block(zram, nr, zram->block) < 0) return EOF;
+        }
+
+        ptr += secs * SECTOR_SIZE;
+        lba += secs;
+        count -= secs;
+    }
+    return 0;
+}
+
+// 创建压缩内存虚拟磁盘 zram0，并格式化为 MINIX 文件系统
+// 磁盘没有请求队列，请求不经过 I/O 调度器，提交时直接同步完成
+void zram_init() {
+    if (ZRAM_SIZE == 0) {
+        return;
+    }
+
+    zram_t *disk = &zram;
+    strcpy(disk->name, "zram0");
+    disk->blocks = ZRAM_SIZE / ZRAM_BLOCK_SIZE;
+
+    // 未写入的块都是全零块
+    size_t table_pages = div_round_up(disk->blocks * sizeof(zram_handle_t), PAGE_SIZE);
+    disk->table = (zram_handle_t *)kalloc_page(table_pages);
+    memset(disk->table, 0, table_pages * PAGE_SIZE);
+    disk->zeros = disk->blocks;
+    disk->pages = 0;
+    disk->stored = 0;
+
+    for (size_t i = 0; i < ZRAM_CLASS_NR; i++) {
+        list_init(&disk->classes[i]);
+    }
+
+    // 块缓冲区、压缩结果缓冲区和哈希表共用一页
+    u8 *page = (u8 *)kalloc_page(1);
+    disk->block = page;
+    disk->compressed = page + ZRAM_BLOCK_SIZE;
+    disk->hash = (u16 *)(page + ZRAM_BLOCK_SIZE * 2);
+
+    LOGK("zram %s blocks %d\n", disk->name, disk->blocks);
+    devid_t dev_id = dev_install(DEV_BLOCK, DEV_ZRAM, disk, disk->name, -1,
+                                 zram_ioctl, zram_read, zram_write);
+    minix_mkfs(dev_id);
+}
@@ -0,0 +1,186 @@
+#include <xos/lz4.h>
+#include <xos/string.h>
+#include <xos/stdlib.h>
+
+#define LZ4_MINMATCH        4   // 最短匹配长度
+#define LZ4_LASTLITERALS    5   // 块末尾至少保留的字面量字节数
+#define LZ4_MFLIMIT         12  // 匹配必须在块末尾该字节数之前开始
+#define LZ4_MAX_OFFSET      0xffff  // 最大匹配距离
+
+// 读取 p 处的 4 字节 (x86 允许非对齐访问)
+static _inline u32 lz4_read32(const u8 *p) {
+    return *(const u32 *)p;
+}
+
+// 4 字节序列的哈希值
+static _inline u32 lz4_hash(u32 seq) {
+    return (seq * 2654435761u) >> (32 - LZ4_HASH_BITS);
+}
+
+// 写入长度 len 超出 token 的部分 (每字节 255，最后一字节小于 255)
+static u8 *lz4_write_length(u8 *dst, size_t len) {
+    while (len >= 255) {
+        *dst++ = 255;
+        len -= 255;
+    }
+    *dst++ = len;
+    return dst;
+}
+
+// 长度 len 超出 token 的部分需要的字节数
+static _inline size_t lz4_length_bytes(size_t len) {
+    return len >= 15 ? (len - 15) / 255 + 1 : 0;
+}
+
+// 输出一个序列：literals 个字面量 anchor，之后是距离为 offset、长度为 match 的匹配 (match 为 0 表示最后的字面量)
+// 输出空间不足时返回 NULL
+static u8 *lz4_sequence(u8 *dst, u8 *end, const u8 *anchor, size_t literals, size_t offset, size_t match) {
+    size_t need = 1 + lz4_length_bytes(literals) + literals;
+    if (match) {
+        need += 2 + lz4_length_bytes(match - LZ4_MINMATCH);
+    }
+    if (need > (size_t)(end - dst)) {
+        return NULL;
+    }
+
+    u8 *token = dst++;
+    *token = MIN(literals, 15) << 4;
+    if (literals >= 15) {
+        dst = lz4_write_length(dst, literals - 15);
+    }
+    memcpy(dst, anchor, literals);
+    dst += literals;
+
+    if (match) {
+        *dst++ = offset & 0xff;
+        *dst++ = offset >> 8;
+        match -= LZ4_MINMATCH;
+        *token |= MIN(match, 15);
+        if (match >= 15) {
+            dst = lz4_write_length(dst, match - 15);
+        }
+    }
+    return dst;
+}
+
+// 使用 LZ4 块格式压缩 src 中的 size 字节 (不超过 64K) 到 dst，table 为 LZ4_HASH_SIZE 项的哈希表
+// 返回压缩后的字节数，压缩结果超过 capacity 时返回 0
+size_t lz4_compress(const void *src, size_t size, void *dst, size_t capacity, u16 *table) {
+    const u8 *base = (const u8 *)src;
+    const u8 *end = base + size;
+    const u8 *anchor = base;
+    const u8 *ip = base;
+    u8 *op = (u8 *)dst;
+    u8 *oend = op + capacity;
+
+    memset(table, 0, LZ4_HASH_SIZE * sizeof(u16));
+
+    if (size > LZ4_MFLIMIT) {
+        const u8 *limit = end - LZ4_MFLIMIT;
+        const u8 *match_end = end - LZ4_LASTLITERALS;
+
+        while (ip < limit) {
+            // 用哈希表查找之前出现过的相同 4 字节序列
+            u32 seq = lz4_read32(ip);
+            u32 hash = lz4_hash(seq);
+            const u8 *ref = base + table[hash];
+            table[hash] = ip - base;
+
+            if (ref >= ip || ip - ref > LZ4_MAX_OFFSET || lz4_read32(ref) != seq) {
+                ip++;
+                continue;
+            }
+
+            // 向后扩展匹配，再向前扩展到上一个序列的末尾
+            size_t len = LZ4_MINMATCH;
+            while (ip + len < match_end && ip[len] == ref[len]) {
+                len++;
+            }
+            while (ip > anchor && ref > base && ip[-1] == ref[-1]) {
+                ip--;
+                ref--;
+                len++;
+            }
+
+            op = lz4_sequence(op, oend, anchor, ip - anchor, ip - ref, len);
+            if (op == NULL) {
+                return 0;
+            }
+            ip += len;
+            anchor = ip;
+        }
+    }
+
+    // 剩余的字节作为最后的字面量
+    op = lz4_sequence(op, oend, anchor, end - anchor, 0, 0);
+    if (op == NULL) {
+        return 0;
+    }
+    return op - (u8 *)dst;
+}
+
+// 读取超出 token 的长度，累加到 len，数据不完整时返回 NULL
+static const u8 *lz4_read_length(const u8 *ip, const u8 *end, size_t *len) {
+    u8 byte;
+    do {
+        if (ip >= end) {
+            return NULL;
+        }
+        byte = *ip++;
+        *len += byte;
+    } while (byte == 255);
+    return ip;
+}
+
+// 解压 src 中 size 字节的 LZ4 块到 dst，返回解压后的字节数，数据损坏或超过 capacity 时返回 EOF
+i32 lz4_decompress(const void *src, size_t size, void *dst, size_t capacity) {
+    const u8 *ip = (const u8 *)src;
+    const u8 *end = ip + size;
+    u8 *op = (u8 *)dst;
+    u8 *oend = op + capacity;
+
+    while (ip < end) {
+        u8 token = *ip++;
+
+        // 字面量
+        size_t literals = token >> 4;
+        if (literals == 15 && (ip = lz4_read_length(ip, end, &literals)) == NULL) {
+            return EOF;
+        }
+        if (literals > (size_t)(end - ip) || literals > (size_t)(oend - op)) {
+            return EOF;
+        }
+        memcpy(op, ip, literals);
+        op += literals;
+        ip += literals;
+
+        // 最后一个序列只有字面量
+        if (ip == end) {
+            break;
+        }
+
+        // 匹配，距离可能小于长度，需要逐字节复制
+        if (end - ip < 2) {
+            return EOF;
+        }
+        size_t offset = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (offset == 0 || offset > (size_t)(op - (u8 *)dst)) {
+            return EOF;
+        }
+
+        size_t match = token & 15;
+        if (match == 15 && (ip = lz4_read_length(ip, end, &match)) == NULL) {
+            return EOF;
+        }
+        match += LZ4_MINMATCH;
+        if (match > (size_t)(oend - op)) {
+            return EOF;
+        }
+        const u8 *ref = op - offset;
+        while (match--) {
+            *op++ = *ref++;
+        }
+    }
+    return op - (u8 *)dst;
+}
@@ -115,6 +115,19 @@ void *memcpy(void *dest, const void *src, size_t count) {
     return dest;
 }
 
+// copies one buffer to another, the buffers may overlap
+void *memmove(void *dest, const void *src, size_t count) {
+    if (dest <= src || (u8 *)dest >= (u8 *)src + count) {
+        return memcpy(dest, src, count);
+    }
+    u8 *ptr = (u8 *)dest + count;
+    u8 *str = (u8 *)src + count;
+    while (count--) {
+        *--ptr = *--str;
+    }
+    return dest;
+}
+
 // searches an array for the first occurrence of a character
 void *memchr(const void *ptr, int ch, size_t count) {
     u8 *str = (u8 *)ptr;
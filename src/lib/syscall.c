@@ -56,6 +56,14 @@ void sleep(u32 ms) {
     _syscall1(SYS_SLEEP, ms);
 }
 
+i32 bufstat(buffer_stat_t *info) {
+    return _syscall1(SYS_BUFSTAT, (u32)info);
+}
+
+i32 iostat(devid_t dev_id, dev_stat_t *stat) {
+    return _syscall2(SYS_IOSTAT, dev_id, (u32)stat);
+}
+
 i32 write(fd_t fd, const void *buf, size_t len) {
     return _syscall3(SYS_WRITE, (u32)fd, (u32)buf, (u32)len);
 }
@@ -88,6 +96,10 @@ time_t time() {
     return _syscall0(SYS_TIME);
 }
 
+i32 sync() {
+    return _syscall0(SYS_SYNC);
+}
+
 mode_t umask(mode_t mask) {
     return _syscall1(SYS_UMASK, (u32)mask);
 }
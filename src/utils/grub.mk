@@ -4,13 +4,30 @@ ISO := $(TARGET)/system.iso
 # grub 启动的配置文件
 GRUB_CFG := $(SRC)/utils/grub.cfg
 
-$(ISO): $(SYSTEM_ELF) $(GRUB_CFG)
+# 作为 grub 模块加载的 initrd，启动时拷贝到内核虚拟磁盘并作为根文件系统
+INITRD := $(TARGET)/initrd.img
+
+$(INITRD):
+# 创建一个 1M 的 minix 文件系统镜像，不能超过内核虚拟磁盘的大小
+	dd if=/dev/zero of=$@ bs=1K count=1024
+	mkfs.minix -1 -n 14 $@
+# 挂载镜像到主机的 /mnt 目录
+	sudo mount -o loop $@ /mnt
+	sudo chown ${USER} /mnt
+# 创建目录和文件
+	mkdir -p /mnt/home
+	echo "Hello XOS!!!, from initrd root direcotry file..." > /mnt/hello.txt
+# 从主机上卸载文件系统
+	sudo umount /mnt
+
+$(ISO): $(SYSTEM_ELF) $(GRUB_CFG) $(INITRD)
 # 检测内核目标文件是否合法
 	grub-file --is-x86-multiboot2 $<
 # 创建 iso 目录
 	mkdir -p $(TARGET)/iso/boot/grub
-# 拷贝内核目标文件
+# 拷贝内核目标文件和 initrd
 	cp $< $(TARGET)/iso/boot
+	cp $(INITRD) $(TARGET)/iso/boot
 # 拷贝 grub 配置文件
 	cp $(GRUB_CFG) $(TARGET)/iso/boot/grub
 # 生成 iso 格式的内核镜像